@@ -10,6 +10,9 @@
 #include <GeneralConfig.h>
 #include <wxFFileLog.h>
 #include <CallbackData.h>
+#include <Database.h>
+#include <Statement.h>
+#include <ResearchScope.h>
 
 //(*InternalHeaders(SQLDialog)
 #include <wx/intl.h>
@@ -80,6 +83,7 @@ SQLDialog::SQLDialog(wxWindow* parent,wxWindowID id,const wxPoint& pos,const wxS
 	Layout();
 
 	Connect(ID_BUTTON1,wxEVT_COMMAND_BUTTON_CLICKED,(wxObjectEventFunction)&SQLDialog::OnButtonExecuteClick);
+	Connect(ID_BUTTON2,wxEVT_COMMAND_BUTTON_CLICKED,(wxObjectEventFunction)&SQLDialog::OnButtonFindClick);
 	//*)
 }
 
@@ -96,16 +100,20 @@ void SQLDialog::OnButtonExecuteClick(wxCommandEvent& event)
 
     GeneralConfig config;
 
+    // ad-hoc queries go through a read-only connection of their own, so they never block a running pipeline,
+    // and whatever transaction, attachment or pragma they leave behind is dropped with the connection
     sqlite3 *db = NULL;
-    int rc = sqlite3_open(config.getDatabase().c_str(), &db);
+    int rc = sqlite3_open_v2(config.getDatabase().c_str(), &db, SQLITE_OPEN_READONLY, NULL);
     if (rc != SQLITE_OK)
     {
+        sqlite3_close(db);
         ListCtrlResults->AppendColumn("error", wxLIST_FORMAT_LEFT, 600);
-        wxString strError = wxString::Format("Cannot open database at location %d", config.getDatabase().c_str());
+        wxString strError = wxString::Format("Cannot open database at location %s", config.getDatabase().c_str());
         logError(strError);
         ListCtrlResults->InsertItem(0, strError);
         return;
     }
+    sqlite3_busy_timeout(db, 30000);
 
     CallbackData data(1000);
     char *errorMessage = NULL;
@@ -144,7 +152,51 @@ void SQLDialog::OnButtonExecuteClick(wxCommandEvent& event)
         ListCtrlResults->AppendColumn("error", wxLIST_FORMAT_LEFT, 600);
         logError(errorMessage);
         ListCtrlResults->InsertItem(0, errorMessage);
+        sqlite3_free(errorMessage);
     }
-    sqlite3_close(db);
+    sqlite3_close_v2(db);
     return;
 }
+
+void SQLDialog::OnButtonFindClick(wxCommandEvent& event)
+{
+    ListCtrlResults->ClearAll();
+    ListCtrlResults->DeleteAllColumns();
+
+    GeneralConfig config;
+
+    // the full-text index ranks the matches, so only the best of them are looked up
+    std::vector<uint64_t> ids;
+    if (!ResearchScope::search(config.getDatabase(), TextCtrlSearch->GetValue().ToStdString(), 1000, ids))
+    {
+        ListCtrlResults->AppendColumn("error", wxLIST_FORMAT_LEFT, 600);
+        ListCtrlResults->InsertItem(0, "The full-text index is not available");
+        return;
+    }
+    if (ids.size() == 0)
+    {
+        ListCtrlResults->AppendColumn("Message", wxLIST_FORMAT_LEFT, 600);
+        ListCtrlResults->InsertItem(0, "No results found");
+        return;
+    }
+
+    ListCtrlResults->AppendColumn("Year");
+    ListCtrlResults->AppendColumn("Title", wxLIST_FORMAT_LEFT, 600);
+    ListCtrlResults->AppendColumn("Source");
+    ListCtrlResults->AppendColumn("ID");
+    std::shared_ptr<Database> database = Database::open(config.getDatabase(), true);
+    for (int i = (int)ids.size() - 1; i >= 0; i--)
+    {
+        Statement stmt(database->prepare("SELECT " + Publication::columns(PUB_TITLE | PUB_SOURCE) + " FROM publications WHERE id = ?;"));
+        if (!stmt.ok())
+            return;
+        stmt.bind(1, ids[i]);
+        if (!stmt.step())
+            continue;
+        Publication pub(stmt);
+        long row = ListCtrlResults->InsertItem(0, wxString::Format("%d", pub.year()));
+        ListCtrlResults->SetItem(row, 1, pub.title().c_str());
+        ListCtrlResults->SetItem(row, 2, pub.source().c_str());
+        ListCtrlResults->SetItem(row, 3, wxString::Format("%llu", pub.id()));
+    }
+}
@@ -47,6 +47,7 @@ class SQLDialog: public wxDialog
 
 		//(*Handlers(SQLDialog)
 		void OnButtonExecuteClick(wxCommandEvent& event);
+		void OnButtonFindClick(wxCommandEvent& event);
 		//*)
 
 		DECLARE_EVENT_TABLE()
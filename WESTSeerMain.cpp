@@ -80,6 +80,7 @@ const long WESTSeerFrame::ID_MENUITEM7 = wxNewId();
 const long WESTSeerFrame::ID_MENUITEM8 = wxNewId();
 const long WESTSeerFrame::ID_MENUITEM9 = wxNewId();
 const long WESTSeerFrame::ID_MENUITEM10 = wxNewId();
+const long WESTSeerFrame::ID_MENUITEM11 = wxNewId();
 const long WESTSeerFrame::idMenuAbout = wxNewId();
 const long WESTSeerFrame::ID_STATUSBAR1 = wxNewId();
 //*)
@@ -181,6 +182,8 @@ WESTSeerFrame::WESTSeerFrame(wxWindow* parent,wxWindowID id)
     Menu4->Append(MenuItemBackward);
     MenuItem5 = new wxMenuItem(Menu4, ID_MENUITEM10, _("&Back to Last Task"), wxEmptyString, wxITEM_NORMAL);
     Menu4->Append(MenuItem5);
+    MenuItemMaintenance = new wxMenuItem(Menu4, ID_MENUITEM11, _("&Maintenance"), wxEmptyString, wxITEM_NORMAL);
+    Menu4->Append(MenuItemMaintenance);
     MenuBar1->Append(Menu4, _("&Debug"));
     Menu2 = new wxMenu();
     MenuItem2 = new wxMenuItem(Menu2, idMenuAbout, _("&About\tF1"), _("Show info about this application"), wxITEM_NORMAL);
@@ -207,6 +210,7 @@ WESTSeerFrame::WESTSeerFrame(wxWindow* parent,wxWindowID id)
     Connect(ID_MENUITEM2,wxEVT_COMMAND_MENU_SELECTED,(wxObjectEventFunction)&WESTSeerFrame::OnTextModeSelected);
     Connect(ID_MENUITEM6,wxEVT_COMMAND_MENU_SELECTED,(wxObjectEventFunction)&WESTSeerFrame::OnMenuItemSQLSelected);
     Connect(ID_MENUITEM7,wxEVT_COMMAND_MENU_SELECTED,(wxObjectEventFunction)&WESTSeerFrame::OnMenuItemLogSelected);
+    Connect(ID_MENUITEM11,wxEVT_COMMAND_MENU_SELECTED,(wxObjectEventFunction)&WESTSeerFrame::OnMenuItemMaintenanceSelected);
     Connect(idMenuAbout,wxEVT_COMMAND_MENU_SELECTED,(wxObjectEventFunction)&WESTSeerFrame::OnAbout);
     //*)
 
@@ -220,6 +224,7 @@ WESTSeerFrame::WESTSeerFrame(wxWindow* parent,wxWindowID id)
     _timeSeriesExtraction = NULL;
     _predictionModel = NULL;
     _metricModel = NULL;
+    _maintenance = NULL;
     _exploreMode = true;
     _progressReporter = new MyProgressReporter(this);
     GeneralConfig config;
@@ -244,10 +249,9 @@ void WESTSeerFrame::showCandidate(uint64_t id)
     GeneralConfig config;
     std::string path = config.getDatabase();
     std::string kws = ChoiceScope->GetString(ChoiceScope->GetSelection()).ToStdString();
-    ResearchScope scope(path, kws);
-    Publication pub = scope.getPublication(id);
+    ResearchScope scope(path, kws, true);
     int ye = _exploreMode ? WESTSeerApp::year() + 5 : WESTSeerApp::year();
-    Publication me = scope.getPublication(id);
+    Publication me = scope.getPublication(id, PUB_ABSTRACT);
     std::pair<std::string,string> topic = scope.getTopic(id, ye, _topicIdentification);
     StaticTextTopicSummary->SetLabel(topic.second);
     StaticTextAbstract->SetLabel(me.abstract());
@@ -289,7 +293,7 @@ void WESTSeerFrame::showCandidate(uint64_t id)
     ListCtrlCitations->AppendColumn("Authors");
     ListCtrlCitations->AppendColumn("Source");
     ListCtrlCitations->AppendColumn("ID");
-    std::vector<Publication> citations = scope.getCitations(id, ye);
+    std::vector<Publication> citations = scope.getCitations(id, ye, PUB_HEADER);
     for (Publication pub: citations)
     {
         long row = ListCtrlCitations->InsertItem(0, wxString::Format("%d", pub.year()));
@@ -313,7 +317,7 @@ void WESTSeerFrame::showCandidate(uint64_t id)
     ListCtrlReferences->AppendColumn("Authors");
     ListCtrlReferences->AppendColumn("Source");
     ListCtrlReferences->AppendColumn("ID");
-    std::vector<Publication> references = scope.getReferences(id);
+    std::vector<Publication> references = scope.getReferences(id, PUB_HEADER);
     for (Publication pub: references)
     {
         long row = ListCtrlReferences->InsertItem(0, wxString::Format("%d", pub.year()));
@@ -338,7 +342,7 @@ void WESTSeerFrame::showCandidate(uint64_t id)
     ListCtrlTopicPapers->AppendColumn("Authors");
     ListCtrlTopicPapers->AppendColumn("Source");
     ListCtrlTopicPapers->AppendColumn("ID");
-    std::vector<Publication> topicPapers = scope.getTopicPublications(id, ye, _bitermWeight, _topicIdentification);
+    std::vector<Publication> topicPapers = scope.getTopicPublications(id, ye, _bitermWeight, _topicIdentification, PUB_HEADER);
     for (Publication pub: topicPapers)
     {
         long row = ListCtrlTopicPapers->InsertItem(0, wxString::Format("%d", pub.year()));
@@ -379,7 +383,7 @@ void WESTSeerFrame::showCandidates()
     GeneralConfig config;
     std::string path = config.getDatabase();
     std::string kws = ChoiceScope->GetString(ChoiceScope->GetSelection()).ToStdString();
-    ResearchScope scope(path, kws);
+    ResearchScope scope(path, kws, true);
     std::vector<uint64_t> ids;
     std::vector<int> pRanks, vRanks;
     std::map<uint64_t,std::vector<double>> scores;
@@ -416,7 +420,7 @@ void WESTSeerFrame::showCandidates()
             _vRanks[pRanks[i]] = vRanks[i];
         }
 
-        std::vector<Publication> pubs = scope.getPublications(_ids);
+        std::vector<Publication> pubs = scope.getPublications(_ids, PUB_HEADER);
         std::map<uint64_t,Publication> pubMap;
         for (Publication pub: pubs)
         {
@@ -485,7 +489,7 @@ void WESTSeerFrame::MyProgressReporter::report(
     _frame->GaugeStep->SetValue(taskProgress);
     _frame->GaugeOverall->SetValue(100 * taskId / numTasks);
 
-    if (strcmp(taskName, "Done") == 0 || strcmp(taskName, "Cancelled") == 0)
+    if (strcmp(taskName, "Done") == 0 || strcmp(taskName, "Cancelled") == 0 || strcmp(taskName, "Failed") == 0)
     {
         if (strcmp(taskName, "Done") == 0)
         {
@@ -571,8 +575,45 @@ void WESTSeerFrame::OnMenuItemLogSelected(wxCommandEvent& event)
     dlg.ShowModal();
 }
 
+void WESTSeerFrame::OnMenuItemMaintenanceSelected(wxCommandEvent& event)
+{
+    // offer to remove the selected scope, whose derived rows and unshared queries are then deleted too
+    std::vector<std::string> removedKeywords;
+    int idxKW = ChoiceScope->GetSelection();
+    if (idxKW != wxNOT_FOUND)
+    {
+        wxString kws = ChoiceScope->GetString(idxKW);
+        int answer = wxMessageBox("Remove the research scope \"" + kws + "\" and everything collected for it?",
+            _("Maintenance"), wxYES_NO | wxCANCEL | wxICON_QUESTION, this);
+        if (answer == wxCANCEL)
+            return;
+        if (answer == wxYES)
+            removedKeywords.push_back(kws.ToStdString());
+    }
+
+    // maintenance deletes rows the analysis may be reading, so pause it first
+    AbstractTask::setProgressReporter(NULL);
+    AbstractTask::cancel();
+    AbstractTask::finalize();
+    clearCandidates();
+    clearScope();
+    if (!removedKeywords.empty())
+    {
+        ChoiceScope->Delete(idxKW);
+        ChoiceScope->SetSelection(wxNOT_FOUND);
+    }
+
+    AbstractTask::setProgressReporter(_progressReporter);
+    GeneralConfig config;
+    _maintenance = new DatabaseMaintenance(config.getDatabase(), removedKeywords);
+    _maintenance->runAll();
+}
+
 void WESTSeerFrame::OnChoiceScopeSelect(wxCommandEvent& event)
 {
+    // maintenance may have removed the selected scope, leaving nothing to analyse
+    if (ChoiceScope->GetSelection() == wxNOT_FOUND)
+        return;
     clearCandidates();
     clearScope();
     AbstractTask::setProgressReporter(_progressReporter);
@@ -664,6 +705,11 @@ void WESTSeerFrame::clearScope()
         delete _metricModel;
         _metricModel = NULL;
     }
+    if (_maintenance != NULL)
+    {
+        delete _maintenance;
+        _maintenance = NULL;
+    }
 }
 
 void WESTSeerFrame::OnButtonPauseClick(wxCommandEvent& event)
@@ -676,6 +722,13 @@ void WESTSeerFrame::OnButtonPauseClick(wxCommandEvent& event)
 
 void WESTSeerFrame::OnButtonResumeClick(wxCommandEvent& event)
 {
+    // a paused maintenance is run again, its steps being safe to repeat, rather than the analysis
+    if (_maintenance != NULL)
+    {
+        AbstractTask::setProgressReporter(_progressReporter);
+        _maintenance->runAll();
+        return;
+    }
     OnChoiceScopeSelect(event);
 }
 
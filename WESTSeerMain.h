@@ -34,6 +34,7 @@
 #include <TimeSeriesExtraction.h>
 #include <PredictionModel.h>
 #include <MetricModel.h>
+#include <DatabaseMaintenance.h>
 
 class WESTSeerFrame: public wxFrame
 {
@@ -57,6 +58,7 @@ class WESTSeerFrame: public wxFrame
         void OnExploreModeSelected(wxCommandEvent& event);
         void OnTextModeSelected(wxCommandEvent& event);
         void OnListCtrlPublicationsItemSelect(wxListEvent& event);
+        void OnMenuItemMaintenanceSelected(wxCommandEvent& event);
         //*)
 
         //(*Identifiers(WESTSeerFrame)
@@ -89,6 +91,7 @@ class WESTSeerFrame: public wxFrame
         static const long ID_MENUITEM8;
         static const long ID_MENUITEM9;
         static const long ID_MENUITEM10;
+        static const long ID_MENUITEM11;
         static const long idMenuAbout;
         static const long ID_STATUSBAR1;
         //*)
@@ -114,6 +117,7 @@ class WESTSeerFrame: public wxFrame
         wxMenuItem* MenuItemBackward;
         wxMenuItem* MenuItemForward;
         wxMenuItem* MenuItemLog;
+        wxMenuItem* MenuItemMaintenance;
         wxMenuItem* MenuItemOptions;
         wxMenuItem* MenuItemSQL;
         wxNotebook* NotebookInfo;
@@ -147,6 +151,7 @@ class WESTSeerFrame: public wxFrame
         TimeSeriesExtraction *_timeSeriesExtraction;
         PredictionModel *_predictionModel;
         MetricModel *_metricModel;
+        DatabaseMaintenance *_maintenance;
         bool _exploreMode;
         std::vector<uint64_t> _ids;
         std::vector<int> _vRanks;
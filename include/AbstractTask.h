@@ -14,6 +14,7 @@ class AbstractTask
         virtual const char *name() = 0;
         virtual int numSteps() = 0;
         virtual void doStep(int stepId) = 0;
+        virtual bool flush();
         void runAll();
         static void cancel();
         static void setProgressReporter(ProgressReporter *value);
@@ -15,10 +15,11 @@ class BitermDf: public AbstractTask
         virtual const char *name();
         virtual int numSteps();
         virtual void doStep(int stepId);
-        bool load(int y, std::map<std::string, int> *bitermDfs);
+        virtual bool flush();
+        bool load(int y, std::map<Biterm, int> *bitermDfs);
 
     protected:
-        bool save(int y, const std::map<std::string, int> &bitermDfs);
+        bool save(int y, const std::map<Biterm, int> &bitermDfs);
         bool process(int y);
 
     private:
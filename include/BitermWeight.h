@@ -4,6 +4,7 @@
 #include <ResearchScope.h>
 #include <TermTfIrdf.h>
 #include <BitermDf.h>
+#include <FeatureSnapshot.h>
 #include <string>
 #include <map>
 
@@ -16,10 +17,13 @@ class BitermWeight: public AbstractTask
         virtual const char *name();
         virtual int numSteps();
         virtual void doStep(int stepId);
-        bool load(int y, std::map<uint64_t, std::map<std::string, double>> *bitermWeights);
+        virtual bool flush();
+        bool load(int y, std::map<uint64_t, std::map<Biterm, double>> *bitermWeights);
+        bool load(int y, std::shared_ptr<const FeatureSnapshot> &snapshot);
 
     protected:
-        bool save(int y, std::map<uint64_t, std::map<std::string, double>> &bitermWeights);
+        bool save(int y, std::map<uint64_t, std::map<Biterm, double>> &bitermWeights);
+        bool getUpdateTime(int y, int64_t &updateTime);
         bool process(int y);
 
     private:
@@ -0,0 +1,62 @@
+#ifndef BLOB_H
+#define BLOB_H
+#include <cstdint>
+#include <string>
+#include <map>
+#include <util/string_view.h>
+
+// Compact binary encoding for values stored in BLOB columns. A blob starts
+// with a one-byte format version, followed by varint counts and lengths,
+// length-prefixed strings and raw little-endian numbers, in whatever order
+// the writer and reader of a column agree on.
+class BlobWriter
+{
+    public:
+        BlobWriter(uint8_t version = VERSION);
+        virtual ~BlobWriter();
+        void writeVarint(uint64_t value);
+        void writeString(const std::string &value);
+        void writeDouble(double value);
+        void writeBytes(const void *data, size_t size);
+        inline const std::string &bytes() const
+        {
+            return _bytes;
+        }
+
+        static const uint8_t VERSION = 1;
+
+    private:
+        std::string _bytes;
+};
+
+// Reads a blob in place. Strings are returned as views into the blob, so
+// they are only valid as long as the blob itself. Reading past the end or a
+// blob of another version makes ok() false.
+class BlobReader
+{
+    public:
+        BlobReader(meta::util::string_view bytes, uint8_t version = BlobWriter::VERSION);
+        virtual ~BlobReader();
+        inline bool ok() const
+        {
+            return _ok;
+        }
+        inline bool atEnd() const
+        {
+            return _p == _end;
+        }
+        uint64_t readVarint();
+        meta::util::string_view readString();
+        double readDouble();
+        meta::util::string_view readBytes(size_t size);
+
+    private:
+        const unsigned char *_p;
+        const unsigned char *_end;
+        bool _ok;
+};
+
+std::string encodeWeights(const std::map<std::string, double> &weights);
+bool decodeWeights(meta::util::string_view bytes, std::map<std::string, double> &weights);
+
+#endif // BLOB_H
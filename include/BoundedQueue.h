@@ -0,0 +1,81 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+// A queue between the threads of a pipeline. Producers block while it holds
+// capacity items, so a fast stage cannot run ahead of a slow one by more than
+// that, and consumers block while it is empty. Once the producers are done
+// they close it, after which consumers get what is left and then false.
+template <typename T>
+class BoundedQueue
+{
+    public:
+        BoundedQueue(size_t capacity)
+        {
+            //ctor
+            _capacity = capacity > 0 ? capacity : 1;
+            _closed = false;
+        }
+        virtual ~BoundedQueue()
+        {
+            //dtor
+        }
+
+        // add an item, returning false if the queue was closed meanwhile
+        bool push(T item)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _notFull.wait(lock, [this]()
+                {
+                    return _closed || _items.size() < _capacity;
+                });
+            if (_closed)
+                return false;
+            _items.push_back(std::move(item));
+            lock.unlock();
+            _notEmpty.notify_one();
+            return true;
+        }
+
+        // take the oldest item, returning false once the queue is closed and empty
+        bool pop(T &item)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _notEmpty.wait(lock, [this]()
+                {
+                    return _closed || !_items.empty();
+                });
+            if (_items.empty())
+                return false;
+            item = std::move(_items.front());
+            _items.pop_front();
+            lock.unlock();
+            _notFull.notify_one();
+            return true;
+        }
+
+        void close()
+        {
+            {
+                std::lock_guard<std::mutex> lock(_mutex);
+                _closed = true;
+            }
+            _notFull.notify_all();
+            _notEmpty.notify_all();
+        }
+
+    private:
+        BoundedQueue(const BoundedQueue &);
+        BoundedQueue &operator=(const BoundedQueue &);
+        std::mutex _mutex;
+        std::condition_variable _notFull;
+        std::condition_variable _notEmpty;
+        std::deque<T> _items;
+        size_t _capacity;
+        bool _closed;
+};
+
+#endif // BOUNDEDQUEUE_H
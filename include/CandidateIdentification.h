@@ -13,6 +13,7 @@ class CandidateIdentification: public AbstractTask
         virtual const char *name();
         virtual int numSteps();
         virtual void doStep(int stepId);
+        virtual bool flush();
         bool load(int y, std::vector<uint64_t> *candidates);
 
     protected:
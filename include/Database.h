@@ -0,0 +1,52 @@
+#ifndef DATABASE_H
+#define DATABASE_H
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <sqlite3.h>
+
+// A database file shared by every research scope and task of a pipeline run.
+// Each thread gets its own long-lived connection, so SQLite's page cache
+// stays warm across all loads and saves made by that thread. Prepared
+// statements are cached per connection and keyed by their SQL text.
+// Writable connections run in WAL mode, so read-only connections opened by
+// the GUI can browse the file while a pipeline run is writing to it. A
+// connection is closed when its thread exits, so the short-lived threads of
+// crawls and writers do not leave their connections open until the database
+// is released.
+class Database: public std::enable_shared_from_this<Database>
+{
+    public:
+        Database(const std::string path, bool readOnly = false);
+        virtual ~Database();
+        const std::string &path() const;
+        bool readOnly() const;
+        sqlite3 *handle();
+        sqlite3_stmt *prepare(const std::string &sql);
+        void release();
+
+        static std::shared_ptr<Database> open(const std::string path, bool readOnly = false);
+
+    protected:
+        struct Connection
+        {
+            sqlite3 *db;
+            std::map<std::string, sqlite3_stmt *> statements;
+        };
+        Connection *connection();
+        bool configure(sqlite3 *db);
+        static void close(Connection &conn);
+
+    private:
+        std::string _path;
+        bool _readOnly;
+        std::mutex _mutex;
+        std::map<std::thread::id, Connection> _connections;
+
+        static std::mutex _registryMutex;
+        static std::map<std::pair<std::string, bool>, std::weak_ptr<Database>> _registry;
+};
+
+#endif // DATABASE_H
@@ -0,0 +1,62 @@
+#ifndef DATABASEMAINTENANCE_H
+#define DATABASEMAINTENANCE_H
+#include <AbstractTask.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <memory>
+#include <Database.h>
+
+// The rows a research scope owns in the stage tables, their size in bytes
+// counting only the values of text and blob columns, and how many of them are
+// still in the shared database rather than in the partition of the scope.
+struct ScopeFootprint
+{
+    std::string keywords;
+    int64_t numRows;
+    int64_t numBytes;
+    int64_t numSharedRows;
+    bool abandoned;
+    bool partitioned;
+};
+
+// Reclaims the space of a database in the background. It reports the
+// footprint of every scope, drops the derived rows of the scopes it was asked
+// to remove and of abandoned ones, whose keywords are no longer listed in
+// research_scopes, moves the rows of scopes analysed before partitions were
+// turned on into their own files, prunes the publications no remaining query
+// refers to and gives the freed pages back to the file system with
+// incremental vacuum.
+class DatabaseMaintenance: public AbstractTask
+{
+    public:
+        DatabaseMaintenance(const std::string path, const std::vector<std::string> removedKeywords);
+        virtual ~DatabaseMaintenance();
+        virtual bool finished();
+        virtual const char *name();
+        virtual int numSteps();
+        virtual void doStep(int stepId);
+        bool getFootprints(std::vector<ScopeFootprint> &footprints);
+        bool dropScope(const std::string &keywords);
+        bool forgetScope(const std::string &keywords);
+        bool movePartition(const std::string &keywords);
+        bool prunePublications(int64_t &numPruned);
+        bool vacuum();
+
+    protected:
+        bool addFootprints(std::shared_ptr<Database> db, bool shared, std::map<std::string, ScopeFootprint> &footprintOfKeywords);
+        bool copyRows(const std::string &keywords, const std::string &partitionPath);
+        bool deleteRows(std::shared_ptr<Database> db, const std::string &keywords);
+        bool getYears(std::shared_ptr<Database> db, const char *sql, const std::string &keywords, std::set<int> &years);
+        bool removeSnapshots(const std::string &keywords);
+        bool execute(const char *sql);
+
+    private:
+        std::string _path;
+        std::vector<std::string> _removedKeywords;
+        std::vector<ScopeFootprint> _footprints;
+};
+
+#endif // DATABASEMAINTENANCE_H
@@ -0,0 +1,67 @@
+#ifndef FEATURESNAPSHOT_H
+#define FEATURESNAPSHOT_H
+#include <cstdint>
+#include <string>
+#include <map>
+
+// Read-only weighted features of the publications of one year in compressed
+// sparse row layout: a header, the sorted publication ids, one offset per row
+// and the keys and weights of all rows, each array 8-byte aligned. A snapshot
+// is either a file mapped into memory or bytes it owns, and once loaded it
+// can be shared by any number of threads. Files are native-endian caches of
+// rows stored in the database, stamped with the update time of those rows.
+class FeatureSnapshot
+{
+    public:
+        FeatureSnapshot();
+        virtual ~FeatureSnapshot();
+        bool map(const std::string &path);
+        bool assign(std::string &bytes);
+        int64_t stamp() const;
+        size_t numRows() const;
+        size_t find(uint64_t id) const;
+        inline uint64_t id(size_t row) const
+        {
+            return _ids[row];
+        }
+        inline size_t size(size_t row) const
+        {
+            return (size_t)(_offsets[row + 1] - _offsets[row]);
+        }
+        inline const uint64_t *keys(size_t row) const
+        {
+            return _keys + _offsets[row];
+        }
+        inline const double *values(size_t row) const
+        {
+            return _values + _offsets[row];
+        }
+
+        static const size_t npos = (size_t)-1;
+        static std::string encode(const std::map<uint64_t, std::map<uint64_t, double>> &rows, int64_t stamp);
+        static bool write(const std::string &path, const std::string &bytes);
+
+    protected:
+        struct Header
+        {
+            char magic[4];
+            uint32_t version;
+            int64_t stamp;
+            uint64_t numRows;
+            uint64_t numEntries;
+        };
+        bool attach(const char *data, size_t size);
+        void unmap();
+
+    private:
+        std::string _bytes;
+        void *_view;
+        size_t _viewSize;
+        const Header *_header;
+        const uint64_t *_ids;
+        const uint64_t *_offsets;
+        const uint64_t *_keys;
+        const double *_values;
+};
+
+#endif // FEATURESNAPSHOT_H
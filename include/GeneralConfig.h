@@ -31,12 +31,37 @@ class GeneralConfig
         {
             return _citations;
         }
+        const bool getSnapshots()
+        {
+            return _snapshots;
+        }
+        const bool getPartitions()
+        {
+            return _partitions;
+        }
+        const std::string getServer()
+        {
+            return _server;
+        }
+        const int getRequestsPerSecond()
+        {
+            return _requestsPerSecond;
+        }
+        const int getConnections()
+        {
+            return _connections;
+        }
         void setEmail(std::string value);
         void setDatabase(std::string value);
         void setObYears(int value);
         void setBiterms(int value);
         void setTfirdf(double value);
         void setCitations(int value);
+        void setSnapshots(bool value);
+        void setPartitions(bool value);
+        void setServer(std::string value);
+        void setRequestsPerSecond(int value);
+        void setConnections(int value);
         const std::string getLogFile();
 
     protected:
@@ -48,6 +73,11 @@ class GeneralConfig
         int _biterms;
         double _tfirdf;
         int _citations;
+        bool _snapshots;
+        bool _partitions;
+        std::string _server;
+        int _requestsPerSecond;
+        int _connections;
 };
 
 #endif // GENERALCONFIG_H
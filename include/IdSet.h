@@ -0,0 +1,59 @@
+#ifndef IDSET_H
+#define IDSET_H
+#include <cstdint>
+#include <string>
+#include <memory>
+#include <Database.h>
+
+// A set of ids loaded into an indexed temporary table of the calling thread's
+// connection, so that a statement can join against any number of ids instead
+// of binding them one lookup at a time or spelling them out in an IN list.
+// The table is named by the caller, emptied when the set goes out of scope and
+// kept for the next set of the same name, so statements joining it stay
+// cached. Only one set of a name may be alive per thread at a time.
+class IdSet
+{
+    public:
+        IdSet(std::shared_ptr<Database> db, const std::string name);
+        virtual ~IdSet();
+        inline bool ok() const
+        {
+            return _ok;
+        }
+        inline const std::string &table() const
+        {
+            return _table;
+        }
+        template <typename Ids>
+        bool insert(const Ids &ids)
+        {
+            if (!begin())
+                return false;
+            for (uint64_t id: ids)
+            {
+                if (!insert(id))
+                {
+                    end(false);
+                    return false;
+                }
+            }
+            return end(true);
+        }
+
+    protected:
+        bool begin();
+        bool insert(uint64_t id);
+        bool end(bool commit);
+        bool execute(const std::string &sql);
+
+    private:
+        IdSet(const IdSet &);
+        IdSet &operator=(const IdSet &);
+        std::shared_ptr<Database> _db;
+        std::string _table;
+        sqlite3_stmt *_insert;
+        bool _owner;
+        bool _ok;
+};
+
+#endif // IDSET_H
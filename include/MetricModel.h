@@ -15,6 +15,7 @@ class MetricModel: public AbstractTask
         virtual const char *name();
         virtual int numSteps();
         virtual void doStep(int stepId);
+        virtual bool flush();
         bool load(int y, std::map<uint64_t, std::vector<double>> *scores);
 
     protected:
@@ -4,11 +4,16 @@
 #include <vector>
 #include <map>
 #include <set>
+#include <memory>
+#include <future>
 #include <stdint.h>
 #include <AbstractTask.h>
 #include <Publication.h>
 #include <ResearchScope.h>
 #include <ProgressReporter.h>
+#include <OpenAlexClient.h>
+
+class ReferenceFetcher;
 
 class OpenAlex: public AbstractTask {
 	private:
@@ -19,7 +24,11 @@ class OpenAlex: public AbstractTask {
 		int _y2;
 		std::vector<std::pair<int,std::vector<std::string>>> _urls;
 		bool _samplesOnly;
+		bool _upgradeFailed;
 		std::vector<std::vector<Publication>> _samples;
+		std::shared_ptr<OpenAlexClient> _client;
+		std::map<int, std::future<void>> _crawls;
+		std::unique_ptr<ReferenceFetcher> _refs;
 
 	public:
 		OpenAlex(const std::string email, const std::string path,
@@ -31,6 +40,7 @@ class OpenAlex: public AbstractTask {
         virtual const char *name();
         virtual int numSteps();
         virtual void doStep(int stepId);
+        virtual bool flush();
 
 		inline const ResearchScope &scope()
 		{
@@ -51,6 +61,9 @@ class OpenAlex: public AbstractTask {
 
 	protected:
 	    void init();
+	    void crawl(int stepId);
+	    bool crawlWorks(int j, const int y, const std::string &url);
+	    bool parsePage(const std::string &body, std::map<uint64_t, Publication> &pubs, std::vector<Publication> *samples = NULL, std::string *nextCursor = NULL);
 
 };
 #endif
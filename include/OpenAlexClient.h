@@ -0,0 +1,58 @@
+#ifndef OPENALEXCLIENT_H
+#define OPENALEXCLIENT_H
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <RateLimiter.h>
+
+namespace httplib
+{
+    class Client;
+}
+
+// The connections to the OpenAlex API, shared by every crawl of the process.
+// A request borrows a keep-alive connection from the pool, opening a new one
+// while fewer than numConnections are open and waiting for one to be given
+// back otherwise, and takes a token from a rate limiter shared by all
+// connections, so concurrent crawls together stay within the budget of the
+// polite pool. Failed requests are retried with growing delays until they
+// succeed or the caller is cancelled, and a response saying there were too
+// many requests holds every connection back. The server is a setting, so that
+// a crawl can be run against a local stand-in of the API.
+class OpenAlexClient
+{
+    public:
+        OpenAlexClient(const std::string server, int requestsPerSecond, int numConnections);
+        virtual ~OpenAlexClient();
+        bool get(const std::string &path, std::string &body, const std::atomic<bool> &cancelled);
+        inline int numConnections() const
+        {
+            return _numConnections;
+        }
+
+        static std::shared_ptr<OpenAlexClient> open(const std::string server, int requestsPerSecond, int numConnections);
+
+    protected:
+        httplib::Client *borrow();
+        void giveBack(httplib::Client *client);
+
+    private:
+        OpenAlexClient(const OpenAlexClient &);
+        OpenAlexClient &operator=(const OpenAlexClient &);
+        std::string _server;
+        int _numConnections;
+        RateLimiter _limiter;
+        std::mutex _mutex;
+        std::condition_variable _givenBack;
+        std::vector<httplib::Client *> _idle;
+        std::vector<httplib::Client *> _clients;
+
+        static std::mutex _registryMutex;
+        static std::map<std::string, std::weak_ptr<OpenAlexClient>> _registry;
+};
+
+#endif // OPENALEXCLIENT_H
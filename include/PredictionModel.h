@@ -21,6 +21,7 @@ class PredictionModel: public AbstractTask
         bool save(int y, std::map<uint64_t, std::pair<Eigen::MatrixXd,Eigen::MatrixXd>> &prediction);
         bool save(int y, std::vector<double> &loss);
         bool process(int iStep);
+        std::string getCheckpointPath(int y);
 
     private:
         int _y0;
@@ -33,6 +34,7 @@ class PredictionModel: public AbstractTask
         std::vector<Eigen::MatrixXd> _target;
         std::vector<double> _loss;
         std::string _name;
+        bool _warmStart;
 };
 
 #endif // PREDICTIONMODEL_H
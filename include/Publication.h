@@ -6,21 +6,41 @@
 #include <fstream>
 #include <nlohmann/json.hpp>
 #include <sqlite3.h>
+#include <Statement.h>
 #include <wx/string.h>
 using namespace std;
 using namespace nlohmann;
+
+// The columns of a publication row to load. Id and year are always loaded,
+// and the columns left out are selected as empty text, so that every
+// projection of a row is read by the same init(const Statement&).
+enum PublicationFields
+{
+    PUB_TITLE = 1,
+    PUB_ABSTRACT = 2,
+    PUB_SOURCE = 4,
+    PUB_LANGUAGE = 8,
+    PUB_AUTHORS = 16,
+    PUB_REF_IDS = 32,
+    PUB_HEADER = PUB_TITLE | PUB_SOURCE | PUB_AUTHORS,
+    PUB_ALL = PUB_TITLE | PUB_ABSTRACT | PUB_SOURCE | PUB_LANGUAGE | PUB_AUTHORS | PUB_REF_IDS
+};
+
 class Publication
 {
+friend class WorksParser;
 public:
     Publication();
     Publication(const string& strJson);
     Publication(const json& jsonWork);
     Publication(const map<string,string>& work);
+    Publication(const Statement& row);
     Publication(const Publication& another);
     virtual ~Publication();
     void parse(const string& strJson);
     void init(const json& jsonWork);
     void init(const map<string,string>& work);
+    void init(const Statement& row);
     void writeWoS(std::ofstream &streamOut, const map<uint64_t, Publication> &publications);
     inline uint64_t id()
     {
@@ -63,8 +83,10 @@ public:
     {
         return _refIds[i];
     }
+    static string columns(int fields, const string& alias = "");
     static uint64_t convertId(const std::string idString, const char chType);
     static string convertId(const uint64_t id, const char chType);
+    static string convertAuthorName(const string& displayName);
 
 protected:
 
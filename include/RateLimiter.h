@@ -0,0 +1,32 @@
+#ifndef RATELIMITER_H
+#define RATELIMITER_H
+#include <mutex>
+#include <chrono>
+
+// A token bucket shared by the threads making requests to one server. Tokens
+// accrue at rate per second up to burst, and every request takes one. A
+// request finding the bucket empty reserves the next token and sleeps until
+// it is due, so the requests of all threads together keep to the rate
+// whatever their number, in the order they asked.
+class RateLimiter
+{
+    public:
+        RateLimiter(double rate, double burst);
+        virtual ~RateLimiter();
+        void acquire();
+        void backOff(double seconds);
+
+    protected:
+        void refill();
+
+    private:
+        RateLimiter(const RateLimiter &);
+        RateLimiter &operator=(const RateLimiter &);
+        std::mutex _mutex;
+        double _rate;
+        double _burst;
+        double _tokens;
+        std::chrono::steady_clock::time_point _lastRefill;
+};
+
+#endif // RATELIMITER_H
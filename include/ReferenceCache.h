@@ -0,0 +1,51 @@
+#ifndef REFERENCECACHE_H
+#define REFERENCECACHE_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <list>
+#include <memory>
+#include <mutex>
+
+typedef std::map<uint64_t, std::vector<uint64_t>> RefIdsOfId;
+
+// The works of each year of a research scope mapped to their references that
+// are stored as publications. It is shared by every ResearchScope of the same
+// database and keywords, i.e. by all stages of a pipeline run, and holds at
+// most capacity works and references, dropping the least recently used years
+// first. Saving publications invalidates the years they may change.
+class ReferenceCache
+{
+    public:
+        ReferenceCache(size_t capacity = 20000000);
+        virtual ~ReferenceCache();
+        std::shared_ptr<const RefIdsOfId> get(const int y, uint64_t &generation);
+        void put(const int y, std::shared_ptr<const RefIdsOfId> refIdsOfId, uint64_t generation);
+        void invalidate(const int y);
+        void clear();
+
+        static std::shared_ptr<ReferenceCache> open(const std::string path, const std::string keywords);
+
+    protected:
+        struct Entry
+        {
+            std::shared_ptr<const RefIdsOfId> refIdsOfId;
+            size_t size;
+            std::list<int>::iterator lru;
+        };
+        void erase(std::map<int, Entry>::iterator yToEntry);
+
+    private:
+        std::mutex _mutex;
+        size_t _capacity;
+        size_t _size;
+        uint64_t _generation;
+        std::map<int, Entry> _entries;
+        std::list<int> _lru;
+
+        static std::mutex _registryMutex;
+        static std::map<std::pair<std::string, std::string>, std::weak_ptr<ReferenceCache>> _registry;
+};
+
+#endif // REFERENCECACHE_H
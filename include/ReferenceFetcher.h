@@ -0,0 +1,72 @@
+#ifndef REFERENCEFETCHER_H
+#define REFERENCEFETCHER_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <Publication.h>
+#include <ResearchScope.h>
+#include <OpenAlexClient.h>
+#include <BoundedQueue.h>
+
+// The references missing from the database for all combination-years of a
+// crawl, fetched once each. A combination-year whose works are saved adds its
+// missing references, and only those not requested before in the crawl are
+// queued, so the references that many combinations and years share are not
+// fetched again for each of them. Workers, one per connection, request the
+// queued ids as many at a time as the API takes in one filter, and a writer
+// saves what they fetch in bulk. Once all references of a combination-year
+// are saved, its token is written, so an interrupted crawl fetches only the
+// references still missing.
+class ReferenceFetcher
+{
+    public:
+        ReferenceFetcher(ResearchScope &scope, std::shared_ptr<OpenAlexClient> client, const std::string email, const std::atomic<bool> &cancelled);
+        virtual ~ReferenceFetcher();
+        bool add(int idxComb, const int y);
+        bool finish();
+
+    protected:
+        struct Batch
+        {
+            std::vector<uint64_t> ids;
+            std::map<uint64_t, Publication> refs;
+        };
+        struct Waiting
+        {
+            int idxComb;
+            int y;
+            std::set<uint64_t> refIds;
+        };
+        void fetch();
+        void write();
+        bool save(const std::map<uint64_t, Publication> &refs, const std::vector<uint64_t> &ids);
+
+    private:
+        ReferenceFetcher(const ReferenceFetcher &);
+        ReferenceFetcher &operator=(const ReferenceFetcher &);
+        ResearchScope &_scope;
+        std::shared_ptr<OpenAlexClient> _client;
+        std::string _email;
+        const std::atomic<bool> &_cancelled;
+        std::mutex _mutex;
+        std::condition_variable _queued;
+        std::deque<uint64_t> _pending;
+        std::set<uint64_t> _requested;
+        std::set<uint64_t> _saved;
+        std::vector<Waiting> _waiting;
+        bool _finishing;
+        bool _failed;
+        BoundedQueue<Batch> _fetched;
+        std::vector<std::thread *> _workers;
+        std::thread *_writer;
+};
+
+#endif // REFERENCEFETCHER_H
@@ -4,7 +4,16 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <memory>
+#include <atomic>
+#include <functional>
 #include <Publication.h>
+#include <Database.h>
+#include <Statement.h>
+#include <ReferenceCache.h>
+#include <TermDictionary.h>
+#include <WriteBehind.h>
 class BitermWeight;
 class TopicIdentification;
 
@@ -12,37 +21,77 @@ class ResearchScope
 {
     public:
         ResearchScope(const std::string path, const std::string kws1, const std::string kws2);
-        ResearchScope(const std::string path, const std::string keywords);
+        ResearchScope(const std::string path, const std::string keywords, bool readOnly = false);
         virtual ~ResearchScope();
         std::string getKeywords() const;
+        sqlite3 *db() const;
+        std::shared_ptr<Database> database() const;
+        sqlite3_stmt *prepare(const std::string &sql) const;
+        sqlite3 *partitionDb() const;
+        sqlite3_stmt *preparePartition(const std::string &sql) const;
+        std::shared_ptr<TermDictionary> dictionary() const;
+        void saveLater(std::function<bool()> job);
+        bool flush();
+        std::string getSnapshotPath(const std::string &name, const int y) const;
         bool init();
         int numCombinations() const;
         std::string getCombination(int i) const;
         int numPublications(const int y) const;
-        bool load(int idxComb, const int y, std::map<uint64_t, Publication> &pubOfY);
+        bool load(int idxComb, const int y, std::map<uint64_t, Publication> &pubOfY, int fields = PUB_ALL);
         bool load(int idxComb, const int y);
-        bool save(int idxComb, const int y, const std::map<uint64_t, Publication> &pubsOfY);
+        bool queried(const int y) const;
+        bool queried(int idxComb, const int y) const;
+        bool save(int idxComb, const int y, const std::map<uint64_t, Publication> &pubsOfY, bool queried = true, const std::string &cursor = "");
         bool save(const std::map<uint64_t, Publication> &pubsOfY);
         bool save(int idxComb, const int y);
-        bool getExistingRefIds(const int y, std::map<uint64_t, std::vector<uint64_t>> &refIdsOfId);
+        bool getExistingRefIds(const int y, std::shared_ptr<const RefIdsOfId> &refIdsOfId);
         bool getMissingRefIds(int idxComb, const int y, std::vector<uint64_t> &missingRefIds);
-        Publication getPublication(uint64_t id);
-        std::vector<Publication> getPublications(std::vector<uint64_t> ids);
-        std::vector<Publication> getReferences(uint64_t id);
-        std::vector<Publication> getCitations(uint64_t id, int ye);
-        std::vector<Publication> getTopicPublications(uint64_t id, int ye, BitermWeight *bw, TopicIdentification *ti);
+        bool getCursor(int idxComb, const int y, std::string &cursor, int &numWorks);
+        Publication getPublication(uint64_t id, int fields = PUB_ALL);
+        std::vector<Publication> getPublications(std::vector<uint64_t> ids, int fields = PUB_ALL);
+        std::vector<Publication> getReferences(uint64_t id, int fields = PUB_ALL);
+        std::vector<Publication> getCitations(uint64_t id, int ye, int fields = PUB_ALL);
+        bool search(const std::string &text, int limit, std::vector<uint64_t> &ids) const;
+        bool searchIndexed();
+        bool createSearchIndex();
+        bool upgraded();
+        bool upgrade();
+        bool getCiters(uint64_t id, const int y0, const int y1, std::map<int, std::set<uint64_t>> &citersOfYear) const;
+        std::vector<Publication> getTopicPublications(uint64_t id, int ye, BitermWeight *bw, TopicIdentification *ti, int fields = PUB_ALL);
         std::pair<std::string,std::string> getTopic(uint64_t id, int ye, TopicIdentification *ti);
 
         static std::vector<std::string> getResearchScopes(const std::string path);
+        static std::string getPartitionPath(const std::string path, const std::string keywords);
+        static bool search(const std::string path, const std::string &text, int limit, std::vector<uint64_t> &ids);
 
     protected:
         bool storable();
+        bool hasTable(const std::string &name);
+        bool hasStageRows();
+        std::shared_ptr<Database> openPartition(bool readOnly);
+        bool queriesUpgraded();
+        bool upgradeQueries();
+        bool upgradeCitations();
         std::string getCombinations();
+        int64_t getCombinationId(const std::string &combination, bool create = false);
+        bool save(const std::map<uint64_t, Publication> &pubs, std::set<int> &changedYears);
+        bool saveCitations(Publication &pub);
+        bool getCitingYears(const std::vector<uint64_t> &ids, std::set<int> &citingYears);
+        bool saveMember(const char *sql, int64_t combinationId, const int y, uint64_t id);
+        bool saveMembers(int idxComb, const int y, const std::map<uint64_t, Publication> &pubsOfY, const std::set<uint64_t> &refIds, bool queried, const std::string &cursor);
+        bool saveCursor(int64_t combinationId, const std::string &combination, const int y, const std::string &cursor);
 
     private:
         std::string _path;
+        std::shared_ptr<Database> _db;
+        std::shared_ptr<Database> _partition;
+        std::shared_ptr<ReferenceCache> _refCache;
+        std::shared_ptr<TermDictionary> _dict;
+        std::shared_ptr<WriteBehind> _writer;
         std::vector<std::string> _kws1;
         std::vector<std::string> _kws2;
+
+        static std::atomic<bool> _searchUnavailable;
 };
 
 #endif // RESEARCHSCOPE_H
@@ -0,0 +1,54 @@
+#ifndef STATEMENT_H
+#define STATEMENT_H
+#include <cstdint>
+#include <string>
+#include <sqlite3.h>
+#include <util/string_view.h>
+
+// A cached prepared statement borrowed for one execution. Values are bound
+// with bind(), rows are fetched with step(), and the statement is reset and
+// its bindings cleared when the borrower goes out of scope. Writers may bind
+// and execute() the same statement repeatedly, once per row. Columns are read
+// by index; getText() views SQLite's own buffer and is only valid until the
+// next step(). getBlob() does the same for binary columns.
+class Statement
+{
+    public:
+        Statement(sqlite3_stmt *stmt);
+        virtual ~Statement();
+        inline bool ok() const
+        {
+            return _stmt != NULL;
+        }
+        void bind(int i, int value);
+        void bind(int i, int64_t value);
+        void bind(int i, uint64_t value);
+        void bind(int i, double value);
+        void bind(int i, const std::string &value);
+        void bindBlob(int i, const std::string &value);
+        bool step();
+        bool execute();
+        bool done() const;
+        const char *errorMessage() const;
+        int numColumns() const;
+        const char *getColumnName(int col) const;
+        bool isNull(int col) const;
+        bool isBlob(int col) const;
+        int getInt(int col) const;
+        int64_t getInt64(int col) const;
+        uint64_t getUInt64(int col) const;
+        double getDouble(int col) const;
+        std::string getString(int col) const;
+        meta::util::string_view getText(int col) const;
+        meta::util::string_view getBlob(int col) const;
+
+    protected:
+
+    private:
+        Statement(const Statement &);
+        Statement &operator=(const Statement &);
+        sqlite3_stmt *_stmt;
+        int _rc;
+};
+
+#endif // STATEMENT_H
@@ -3,7 +3,9 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 #include <wx/string.h>
+#include <util/string_view.h>
 using namespace std;
 
 void removeCharsFromString(string &str, const char* charsToRemove);
@@ -26,4 +28,12 @@ vector<string> tokenize(const string &phrase);
 
 string getVectorStr(const vector<double> &v);
 
+bool nextField(meta::util::string_view &text, char delimiter, meta::util::string_view &field);
+
+uint64_t toUInt64(meta::util::string_view text);
+
+int toInt(meta::util::string_view text);
+
+double toDouble(meta::util::string_view text);
+
 #endif // STRINGPROCESSING_H_INCLUDED
@@ -0,0 +1,63 @@
+#ifndef TERMDICTIONARY_H
+#define TERMDICTIONARY_H
+#include <cstdint>
+#include <string>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <Database.h>
+
+// A biterm packed as the ids of its two terms, the smaller one in the high half.
+typedef uint64_t Biterm;
+
+// The terms of a research scope numbered from 1, with the surface form they
+// were first extracted with. Ids are assigned on first lookup and persisted
+// by save(), which writers call before opening the transaction of the rows
+// that refer to them. The dictionary is shared by every ResearchScope of the
+// same database and keywords, so all stages of a run agree on the ids.
+class TermDictionary
+{
+    public:
+        TermDictionary(const std::string path, const std::string keywords);
+        virtual ~TermDictionary();
+        uint32_t getId(const std::string &stem, const std::string &surface = "");
+        const std::string &stem(uint32_t id);
+        const std::string &surface(uint32_t id);
+        Biterm getBiterm(const std::string &biterm);
+        std::string getString(Biterm biterm);
+        bool save();
+
+        static inline Biterm biterm(uint32_t id1, uint32_t id2)
+        {
+            return id1 < id2 ? ((Biterm)id1 << 32) | id2 : ((Biterm)id2 << 32) | id1;
+        }
+        static inline uint32_t first(Biterm biterm)
+        {
+            return (uint32_t)(biterm >> 32);
+        }
+        static inline uint32_t second(Biterm biterm)
+        {
+            return (uint32_t)(biterm & 0xffffffff);
+        }
+
+        static std::shared_ptr<TermDictionary> open(const std::string path, const std::string keywords);
+        static void invalidate(const std::string path, const std::string keywords);
+
+    protected:
+        bool load();
+
+    private:
+        std::string _path;
+        std::string _keywords;
+        std::mutex _mutex;
+        std::deque<std::string> _stems;
+        std::deque<std::string> _surfaces;
+        std::map<std::string, uint32_t> _idOfStem;
+        size_t _numSaved;
+
+        static std::mutex _registryMutex;
+        static std::map<std::pair<std::string, std::string>, std::weak_ptr<TermDictionary>> _registry;
+};
+
+#endif // TERMDICTIONARY_H
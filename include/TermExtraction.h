@@ -3,11 +3,24 @@
 #include <AbstractTask.h>
 #include <ResearchScope.h>
 #include <map>
+#include <set>
 #include <vector>
 #include <string>
+#include <memory>
 #include <cstdint>
 #include <StopWordMatcher.h>
 #include <Matcher.h>
+#include <util/string_view.h>
+
+// A text normalized and split at punctuations and stop words into terms,
+// with the stem of every token of every term. It does not depend on the
+// research scope, so the tokens of each title and abstract are cached in
+// pub_tokens and shared by the term extraction of all scopes.
+struct TokenizedText
+{
+    std::vector<std::vector<std::string>> terms;
+    std::vector<std::vector<std::string>> stems;
+};
 
 class TermExtraction: public AbstractTask
 {
@@ -18,11 +31,16 @@ class TermExtraction: public AbstractTask
         virtual const char *name();
         virtual int numSteps();
         virtual void doStep(int stepId);
+        virtual bool flush();
         bool load(int y, std::map<uint64_t, std::map<std::string, std::pair<std::string,int>>> *termFreqs, bool loadTerms = true);
 
     protected:
-        bool load(int y, std::map<uint64_t, std::vector<std::string>> &texts);
-        bool save(int y, const std::map<uint64_t, std::map<std::string, std::pair<std::string, int>>> &termFreqs);
+        bool load(int y, std::map<uint64_t, std::vector<std::shared_ptr<const TokenizedText>>> &texts);
+        bool loadTokens(const std::set<uint64_t> &ids, int maxField, std::map<std::pair<uint64_t, int>, std::shared_ptr<const TokenizedText>> &texts);
+        bool decodeTokens(meta::util::string_view bytes, std::shared_ptr<const TokenizedText> &text);
+        bool saveTokens(const std::map<std::pair<uint64_t, int>, std::shared_ptr<const TokenizedText>> &texts);
+        std::shared_ptr<const TokenizedText> tokenizeText(const std::string &text);
+        bool save(int y, const std::map<uint64_t, std::map<std::string, std::pair<std::string, int>>> &termFreqs, const std::string &terms);
 
         std::vector<std::vector<std::string>> split(const std::string text);
         bool process(int y);
@@ -14,10 +14,11 @@ class TermTfIrdf: public AbstractTask
         virtual const char *name();
         virtual int numSteps();
         virtual void doStep(int stepId);
-        bool load(int y, std::map<uint64_t, std::map<std::string, double>> *tfirdfs, bool loadDfs = true);
+        virtual bool flush();
+        bool load(int y, std::map<uint64_t, std::map<uint32_t, double>> *tfirdfs, bool loadDfs = true);
 
     protected:
-        bool save(int y, const std::map<uint64_t, std::map<std::string, double>> &tfirdfs);
+        bool save(int y, const std::map<uint64_t, std::map<uint32_t, double>> &tfirdfs, const std::map<std::string, int> &dfs, int numWorks);
         bool process(int y);
 
     private:
@@ -23,6 +23,7 @@ class TimeSeriesExtraction: public AbstractTask
         virtual const char *name();
         virtual int numSteps();
         virtual void doStep(int stepId);
+        virtual bool flush();
         bool load(int y, std::map<uint64_t, TimeSeriesMatrices> *timeSeries);
 
     protected:
@@ -39,7 +40,9 @@ class TimeSeriesExtraction: public AbstractTask
         TopicIdentification *_ti;
 };
 
-Eigen::MatrixXd deserializeMatrix(std::string s);
-std::string serializeMatrix(Eigen::MatrixXd &matrix);
+Eigen::MatrixXd deserializeMatrix(meta::util::string_view s);
+Eigen::MatrixXd decodeMatrix(meta::util::string_view bytes);
+Eigen::MatrixXd getMatrix(const Statement &stmt, int col);
+std::string serializeMatrix(const Eigen::MatrixXd &matrix);
 
 #endif // TimeSeriesEXTRACTION_H
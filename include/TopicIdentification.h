@@ -18,6 +18,7 @@ class TopicIdentification: public AbstractTask
         virtual const char *name();
         virtual int numSteps();
         virtual void doStep(int stepId);
+        virtual bool flush();
         bool load(int y, std::map<uint64_t,std::pair<std::string,std::string>> *topics);
 
     protected:
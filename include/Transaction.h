@@ -0,0 +1,49 @@
+#ifndef TRANSACTION_H
+#define TRANSACTION_H
+#include <map>
+#include <vector>
+#include <mutex>
+#include <functional>
+#include <sqlite3.h>
+
+// An explicit write transaction on a connection. Bulk writers call step()
+// after each row, which commits and begins anew every batchSize rows, and
+// commit() once the last row, including any token marking the work as done,
+// has been written. Whatever is not committed is rolled back on destruction.
+// A transaction begun while another is open on the connection joins it and
+// leaves committing to the outer one. Actions that must only follow rows
+// becoming durable, such as a cache noting what it has saved, are passed to
+// onCommit(), which runs them once the outermost transaction commits and
+// drops them if it rolls back.
+class Transaction
+{
+    public:
+        Transaction(sqlite3 *db, int batchSize = 10000);
+        virtual ~Transaction();
+        inline bool ok() const
+        {
+            return _active;
+        }
+        bool step();
+        bool commit();
+        void onCommit(std::function<void()> action);
+
+    protected:
+        bool execute(const char *sql);
+        bool commitOwned();
+
+    private:
+        Transaction(const Transaction &);
+        Transaction &operator=(const Transaction &);
+        sqlite3 *_db;
+        bool _owner;
+        bool _active;
+        int _batchSize;
+        int _numRows;
+        std::vector<std::function<void()>> _onCommit;
+
+        static std::mutex _outermostMutex;
+        static std::map<sqlite3 *, Transaction *> _outermost;
+};
+
+#endif // TRANSACTION_H
@@ -0,0 +1,58 @@
+#ifndef WORKSPARSER_H
+#define WORKSPARSER_H
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <nlohmann/json.hpp>
+#include <Publication.h>
+
+// A SAX handler that reads a page of works returned by the OpenAlex API
+// straight into publications, without building the document. It tracks the
+// keys on the path to each value and keeps only the fields a publication
+// has, ignoring whatever else the page holds. The abstract is rebuilt from
+// its inverted index as the positions arrive, each position pointing to its
+// word, which is stored once.
+class WorksParser: public nlohmann::json_sax<nlohmann::json>
+{
+    public:
+        WorksParser(std::map<uint64_t, Publication> &pubs, std::vector<Publication> *samples = NULL);
+        virtual ~WorksParser();
+        inline const std::string &nextCursor() const
+        {
+            return _nextCursor;
+        }
+
+        static const char *FIELDS;
+
+        virtual bool null();
+        virtual bool boolean(bool val);
+        virtual bool number_integer(number_integer_t val);
+        virtual bool number_unsigned(number_unsigned_t val);
+        virtual bool number_float(number_float_t val, const string_t &s);
+        virtual bool string(string_t &val);
+        virtual bool binary(binary_t &val);
+        virtual bool start_object(std::size_t elements);
+        virtual bool key(string_t &val);
+        virtual bool end_object();
+        virtual bool start_array(std::size_t elements);
+        virtual bool end_array();
+        virtual bool parse_error(std::size_t position, const std::string &last_token, const nlohmann::detail::exception &ex);
+
+    protected:
+        bool inWork() const;
+        const std::string &field() const;
+        void position(uint64_t value);
+        void finishWork();
+
+    private:
+        std::map<uint64_t, Publication> &_pubs;
+        std::vector<Publication> *_samples;
+        std::vector<std::string> _path;
+        std::string _nextCursor;
+        Publication _pub;
+        std::vector<std::string> _words;
+        std::vector<int> _wordOfPosition;
+};
+
+#endif // WORKSPARSER_H
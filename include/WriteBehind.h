@@ -0,0 +1,53 @@
+#ifndef WRITEBEHIND_H
+#define WRITEBEHIND_H
+#include <string>
+#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <functional>
+#include <Database.h>
+
+// A writer thread that persists the results of a stage while the stage goes
+// on computing the next year. Each job saves the data it has been handed over
+// together with the token marking that year as done. The writer runs all
+// queued jobs in one transaction of its own connection, which the
+// transactions of the jobs join, so no token becomes visible before the rows
+// it stands for are committed. At most a couple of jobs are queued, so the
+// results waiting to be written do not pile up in memory. There is one
+// writer per database file, shared by all stages writing to it.
+class WriteBehind
+{
+    public:
+        WriteBehind(std::shared_ptr<Database> db);
+        virtual ~WriteBehind();
+        void push(std::function<bool()> job);
+        bool flush();
+
+        static std::shared_ptr<WriteBehind> open(std::shared_ptr<Database> db);
+
+    protected:
+        void run();
+        bool write(std::vector<std::function<bool()>> &jobs);
+
+    private:
+        WriteBehind(const WriteBehind &);
+        WriteBehind &operator=(const WriteBehind &);
+        std::shared_ptr<Database> _db;
+        std::mutex _mutex;
+        std::condition_variable _queued;
+        std::condition_variable _written;
+        std::deque<std::function<bool()>> _jobs;
+        size_t _numWriting;
+        bool _failed;
+        bool _stopped;
+        std::thread _thread;
+
+        static std::mutex _registryMutex;
+        static std::map<std::string, std::weak_ptr<WriteBehind>> _registry;
+};
+
+#endif // WRITEBEHIND_H
@@ -57,16 +57,24 @@ void AbstractTask::runAll()
                     for (int stepId = 0; stepId < n; stepId++)
                     {
                         task->doStep(stepId);
+                        // read once, so that a pause landing during this step cannot skip the flush that stops the run
+                        bool cancelled = _cancelled.load();
+                        // results left to a writer have to be saved before the next task reads them or the run stops
+                        bool saved = true;
+                        if (stepId == n - 1 || cancelled)
+                            saved = task->flush();
                         int taskProgress = 100 * (stepId + 1) / n;
 
                         if (_progressReporter != NULL)
                         {
-                            if (_cancelled.load() == true)
+                            if (!saved)
+                                _progressReporter->report("Failed", taskId, nTasks, taskProgress);
+                            else if (cancelled)
                                 _progressReporter->report("Cancelled", taskId, nTasks, taskProgress);
                             else
                                 _progressReporter->report(task->name(), taskId, nTasks, taskProgress);
                         }
-                        if (_cancelled.load() == true)
+                        if (!saved || cancelled)
                         {
                             _cancelled.store(false);
                             return;
@@ -89,6 +97,12 @@ void AbstractTask::runAll()
     }
 }
 
+// wait until the results of the steps done so far are saved
+bool AbstractTask::flush()
+{
+    return true;
+}
+
 void AbstractTask::cancel()
 {
     if (_taskThread != NULL)
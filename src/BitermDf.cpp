@@ -1,11 +1,10 @@
 #include "BitermDf.h"
 #include <../WESTSeerApp.h>
 #include <GeneralConfig.h>
-#include <CallbackData.h>
+#include <Blob.h>
 #include <wxFFileLog.h>
 #include <StringProcessing.h>
 #include <cstdlib>
-#include <sstream>
 #include <set>
 #include <queue>
 #include <thread>
@@ -52,108 +51,110 @@ void BitermDf::doStep(int stepId)
     process(_y0 + stepId);
 }
 
-void getBitermDfs(std::string strBdfs, std::map<std::string, int> *bitermDfs)
+bool BitermDf::flush()
 {
-    std::vector<std::string> bdfStrs = splitString(strBdfs, ",");
-    for (std::string bdfStr: bdfStrs)
+    return _scope.flush();
+}
+
+// encode biterm dfs as their number followed by the two term ids and df of each biterm
+static std::string encodeBdfs(const std::map<Biterm, int> &bitermDfs)
+{
+    BlobWriter blob(2);
+    blob.writeVarint(bitermDfs.size());
+    for (auto bToF = bitermDfs.begin(); bToF != bitermDfs.end(); bToF++)
     {
-        std::vector<std::string> bfStrs = splitString(bdfStr, ":");
-        std::string biterm = bfStrs[0];
-        int freq = atoi(bfStrs[1].c_str());
-        (*bitermDfs)[biterm] = freq;
+        blob.writeVarint(TermDictionary::first(bToF->first));
+        blob.writeVarint(TermDictionary::second(bToF->first));
+        blob.writeVarint(bToF->second);
     }
+    return blob.bytes();
 }
 
-bool BitermDf::load(int y, std::map<std::string, int> *bitermDfs)
+static bool decodeBdfs(meta::util::string_view bytes, std::map<Biterm, int> *bitermDfs)
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
-
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
+    BlobReader blob(bytes, 2);
+    uint64_t n = blob.readVarint();
+    for (uint64_t i = 0; i < n && blob.ok(); i++)
     {
-        logError(wxT("Cannot open database at" + path));
-        return false;
+        uint32_t id1 = (uint32_t)blob.readVarint();
+        uint32_t id2 = (uint32_t)blob.readVarint();
+        int df = (int)blob.readVarint();
+        if (blob.ok())
+            (*bitermDfs)[TermDictionary::biterm(id1, id2)] = df;
     }
-    CallbackData data;
-    char *errorMessage = NULL;
+    return blob.ok() && blob.atEnd();
+}
 
+bool BitermDf::load(int y, std::map<Biterm, int> *bitermDfs)
+{
     // step 1: load scope bitermDfs
     std::string keywords = _scope.getKeywords();
     if (bitermDfs != NULL)
     {
         bitermDfs->clear();
         {
-            std::stringstream ss;
-            ss << "SELECT keywords, year, bdfs FROM scope_bdfs WHERE keywords = '"
-                << keywords << "' AND year = " << y << ";";
-            logDebug(ss.str().c_str());
-            rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-            if (rc != SQLITE_OK)
+            Statement stmt(_scope.preparePartition("SELECT bdfs FROM scope_bdfs WHERE keywords = ? AND year = ?;"));
+            if (!stmt.ok())
+                return false;
+            stmt.bind(1, keywords);
+            stmt.bind(2, y);
+            if (!stmt.step())
             {
-                logDebug(errorMessage);
-                sqlite3_close(db);
+                if (!stmt.done())
+                    logDebug(stmt.errorMessage());
+                else
+                    logDebug("no results found.");
                 return false;
             }
-            if (data.results.size() == 0)
+            if (stmt.isBlob(0))
             {
-                logDebug("no results found.");
-                sqlite3_close(db);
-                return false;
+                if (!decodeBdfs(stmt.getBlob(0), bitermDfs))
+                {
+                    logError("Corrupted bdfs in scope_bdfs.");
+                    return false;
+                }
+            }
+            else
+            {
+                // rows written by older versions are text
+                std::shared_ptr<TermDictionary> dict = _scope.dictionary();
+                meta::util::string_view text = stmt.getText(0);
+                meta::util::string_view field, biterm, freq;
+                while (nextField(text, ',', field))
+                {
+                    nextField(field, ':', biterm);
+                    nextField(field, ':', freq);
+                    (*bitermDfs)[dict->getBiterm(biterm.to_string())] = toInt(freq);
+                }
             }
-            getBitermDfs(data.results[0]["bdfs"], bitermDfs);
         }
     }
     else
     {
-        std::stringstream ss;
-        ss << "SELECT keywords, year FROM scope_bdfs WHERE keywords = '"
-            << keywords << "' AND year = " << y << ";";
-        logDebug(ss.str().c_str());
-        rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logDebug(errorMessage);
-            sqlite3_close(db);
+        Statement stmt(_scope.preparePartition("SELECT year FROM scope_bdfs WHERE keywords = ? AND year = ?;"));
+        if (!stmt.ok())
             return false;
-        }
-        if (data.results.size() == 0)
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        if (!stmt.step())
         {
-            logDebug("no results found.");
-            sqlite3_close(db);
+            if (!stmt.done())
+                logDebug(stmt.errorMessage());
+            else
+                logDebug("no results found.");
             return false;
         }
     }
 
-    sqlite3_close(db);
-    return data.results.size() > 0;
-}
-
-std::string getStrBdfs(const std::map<std::string, int> &bitermDfs)
-{
-    std::stringstream ss;
-    for (auto bToF = bitermDfs.begin(); bToF != bitermDfs.end(); bToF++)
-    {
-        if (bToF != bitermDfs.begin())
-            ss << ",";
-        ss << bToF->first << ":" << bToF->second;
-    }
-    return ss.str();
+    return true;
 }
 
-bool BitermDf::save(int y, const std::map<std::string, int> &bitermDfs)
+bool BitermDf::save(int y, const std::map<Biterm, int> &bitermDfs)
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
-
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + path));
+    sqlite3 *db = _scope.partitionDb();
+    if (db == NULL)
         return false;
-    }
+    int rc = SQLITE_OK;
     char *errorMessage = NULL;
 
     // step 1: create tables
@@ -173,31 +174,30 @@ bool BitermDf::save(int y, const std::map<std::string, int> &bitermDfs)
         if (rc != SQLITE_OK)
         {
             logError(errorMessage);
-            sqlite3_close(db);
             return false;
         }
     }
 
     // step 2: save scope bdf token
+    if (!_scope.dictionary()->save())
+        return false;
     std::string keywords = _scope.getKeywords();
     {
         time_t t;
         time(&t);
-        std::stringstream ss;
-        std::string strBdfs = getStrBdfs(bitermDfs);
-        ss << "INSERT OR IGNORE INTO scope_bdfs(keywords, year, bdfs, update_time) VALUES ('"
-            << keywords << "'," << y << ",'" << strBdfs << "'," << (int)t << ");";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), NULL, NULL, &errorMessage);
-        if (rc != SQLITE_OK)
+        Statement stmt(_scope.preparePartition("INSERT OR IGNORE INTO scope_bdfs(keywords, year, bdfs, update_time) VALUES (?,?,?,?);"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        stmt.bindBlob(3, encodeBdfs(bitermDfs));
+        stmt.bind(4, (int)t);
+        if (!stmt.execute())
         {
-            logError(errorMessage);
-            sqlite3_close(db);
+            logError(stmt.errorMessage());
             return false;
         }
     }
-    sqlite3_close(db);
     return true;
 }
 
@@ -207,7 +207,7 @@ bool BitermDf::process(int y)
         return true;
 
     // step 1: load publication scope tfirdfs
-    std::map<uint64_t, std::map<std::string, double>> tfirdfs;
+    std::map<uint64_t, std::map<uint32_t, double>> tfirdfs;
     if (!_tt->load(y, &tfirdfs, false))
         return false;
 
@@ -271,7 +271,7 @@ bool BitermDf::process(int y)
         return false;
 
     // step 3: count biterm df for those with two terms of tfirdf above mean
-    std::map<std::string, int> bdfs;
+    std::map<Biterm, int> bdfs;
     for (auto idToWorkTfirdfs = tfirdfs.begin(); idToWorkTfirdfs != tfirdfs.end(); idToWorkTfirdfs++)
     {
         q.push(idToWorkTfirdfs->first);
@@ -281,7 +281,7 @@ bool BitermDf::process(int y)
         threads[tid] = new std::thread(
             [&q, &mq, &tfirdfs, &meanTfirdfs, this, &bdfs]
             {
-                std::map<std::string, int> myBdfs;
+                std::map<Biterm, int> myBdfs;
                 for (;;)
                 {
                     uint64_t id = 0;
@@ -310,7 +310,7 @@ bool BitermDf::process(int y)
                                 continue;
                             if (iter1->first < iter2->first)
                             {
-                                std::string biterm = iter1->first + "&" + iter2->first;
+                                Biterm biterm = TermDictionary::biterm(iter1->first, iter2->first);
                                 auto btToDf = myBdfs.find(biterm);
                                 if (btToDf == myBdfs.end())
                                 {
@@ -355,6 +355,12 @@ bool BitermDf::process(int y)
     if (_cancelled.load() == true)
         return false;
 
-    // step 4: save biterm dfs
-    return save(y, bdfs);
+    // step 4: save biterm dfs while the next year is counted
+    auto results = std::make_shared<std::map<Biterm, int>>();
+    results->swap(bdfs);
+    _scope.saveLater([this, y, results]()
+        {
+            return save(y, *results);
+        });
+    return true;
 }
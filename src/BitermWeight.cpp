@@ -1,7 +1,8 @@
 #include "BitermWeight.h"
 #include <../WESTSeerApp.h>
 #include <GeneralConfig.h>
-#include <CallbackData.h>
+#include <Transaction.h>
+#include <Blob.h>
 #include <StringProcessing.h>
 #include <TimeSeriesRegression.h>
 #include <queue>
@@ -49,84 +50,171 @@ void BitermWeight::doStep(int stepId)
     process(_y0 + stepId);
 }
 
-bool BitermWeight::load(int y, std::map<uint64_t, std::map<std::string, double>> *bitermWeights)
+bool BitermWeight::flush()
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
+    return _scope.flush();
+}
 
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
+// encode the biterm weights of a publication as their number followed by the two term ids and weight of each biterm
+static std::string encodeBws(const std::map<Biterm, double> &bitermWeights)
+{
+    BlobWriter blob(2);
+    blob.writeVarint(bitermWeights.size());
+    for (auto bToW = bitermWeights.begin(); bToW != bitermWeights.end(); bToW++)
     {
-        logError(wxT("Cannot open database at" + path));
-        return false;
+        blob.writeVarint(TermDictionary::first(bToW->first));
+        blob.writeVarint(TermDictionary::second(bToW->first));
+        blob.writeDouble(bToW->second);
     }
-    CallbackData data;
-    char *errorMessage = NULL;
+    return blob.bytes();
+}
 
+static bool decodeBws(meta::util::string_view bytes, std::map<Biterm, double> &bitermWeights)
+{
+    BlobReader blob(bytes, 2);
+    uint64_t n = blob.readVarint();
+    for (uint64_t i = 0; i < n && blob.ok(); i++)
+    {
+        uint32_t id1 = (uint32_t)blob.readVarint();
+        uint32_t id2 = (uint32_t)blob.readVarint();
+        double weight = blob.readDouble();
+        if (blob.ok())
+            bitermWeights[TermDictionary::biterm(id1, id2)] = weight;
+    }
+    return blob.ok() && blob.atEnd();
+}
+
+bool BitermWeight::load(int y, std::map<uint64_t, std::map<Biterm, double>> *bitermWeights)
+{
     // step 1: load scope bitermWeights
     std::string keywords = _scope.getKeywords();
+    std::shared_ptr<TermDictionary> dict = _scope.dictionary();
     if (bitermWeights != NULL)
     {
         bitermWeights->clear();
         {
-            std::stringstream ss;
-            ss << "SELECT id, scope_keywords, year, biterm_weights FROM pub_scope_bws WHERE scope_keywords = '"
-                << keywords << "' AND year = " << y << ";";
-            logDebug(ss.str().c_str());
-            rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-            if (rc != SQLITE_OK)
-            {
-                logDebug(errorMessage);
-                sqlite3_close(db);
+            Statement stmt(_scope.preparePartition("SELECT id, biterm_weights FROM pub_scope_bws WHERE scope_keywords = ? AND year = ?;"));
+            if (!stmt.ok())
                 return false;
-            }
-            for (auto &result: data.results)
+            stmt.bind(1, keywords);
+            stmt.bind(2, y);
+            while (stmt.step())
             {
-                uint64_t id = std::stoull(result["id"]);
-                std::map<std::string, double> bwsOfId;
-                std::vector<std::string> strBWs = splitString(result["biterm_weights"], ",");
-                for (std::string strBW : strBWs)
+                uint64_t id = stmt.getUInt64(0);
+                std::map<Biterm, double> &bwsOfId = (*bitermWeights)[id];
+                if (stmt.isBlob(1) && decodeBws(stmt.getBlob(1), bwsOfId))
+                    continue;
+
+                // rows written by older versions are keyed by "stem1&stem2"
+                std::map<std::string, double> strBws;
+                if (stmt.isBlob(1))
                 {
-                    std::vector<std::string> fields = splitString(strBW, ":");
-                    bwsOfId[fields[0]] = atof(fields[1].c_str());
+                    if (!decodeWeights(stmt.getBlob(1), strBws))
+                    {
+                        logError("Corrupted biterm weights in pub_scope_bws.");
+                        return false;
+                    }
+                }
+                else
+                {
+                    meta::util::string_view text = stmt.getText(1);
+                    meta::util::string_view field, biterm, weight;
+                    while (nextField(text, ',', field))
+                    {
+                        nextField(field, ':', biterm);
+                        nextField(field, ':', weight);
+                        strBws[biterm.to_string()] = toDouble(weight);
+                    }
+                }
+                bwsOfId.clear();
+                for (auto bToW = strBws.begin(); bToW != strBws.end(); bToW++)
+                {
+                    bwsOfId[dict->getBiterm(bToW->first)] = bToW->second;
                 }
-                (*bitermWeights)[id] = bwsOfId;
+            }
+            if (!stmt.done())
+            {
+                logDebug(stmt.errorMessage());
+                return false;
             }
         }
     }
 
     // step 2: load token
-    data.results.clear();
     {
-        std::stringstream ss;
-        ss << "SELECT keywords, year FROM scope_bw_tokens WHERE keywords = '"
-            << keywords << "' AND year = " << y << ";";
-        logDebug(ss.str().c_str());
-        rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
+        Statement stmt(_scope.preparePartition("SELECT year FROM scope_bw_tokens WHERE keywords = ? AND year = ?;"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        if (!stmt.step())
         {
-            logDebug(errorMessage);
-            sqlite3_close(db);
+            if (!stmt.done())
+                logDebug(stmt.errorMessage());
             return false;
         }
     }
-    sqlite3_close(db);
-    return data.results.size() > 0;
+    return true;
 }
 
-bool BitermWeight::save(int y, std::map<uint64_t, std::map<std::string, double>> &bitermWeights)
+bool BitermWeight::getUpdateTime(int y, int64_t &updateTime)
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
+    Statement stmt(_scope.preparePartition("SELECT update_time FROM scope_bw_tokens WHERE keywords = ? AND year = ?;"));
+    if (!stmt.ok())
+        return false;
+    stmt.bind(1, _scope.getKeywords());
+    stmt.bind(2, y);
+    if (!stmt.step())
+    {
+        if (!stmt.done())
+            logDebug(stmt.errorMessage());
+        return false;
+    }
+    updateTime = stmt.getInt64(0);
+    return true;
+}
 
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
+// get the biterm weights of year y as a snapshot, mapping its file if it is as recent as the rows
+// in the database and otherwise building it from them, and rewriting the file if snapshots are on
+bool BitermWeight::load(int y, std::shared_ptr<const FeatureSnapshot> &snapshot)
+{
+    int64_t updateTime = 0;
+    if (!getUpdateTime(y, updateTime))
+        return false;
+    GeneralConfig config;
+    std::string path = _scope.getSnapshotPath("bws", y);
+    if (config.getSnapshots())
     {
-        logError(wxT("Cannot open database at" + path));
+        std::shared_ptr<FeatureSnapshot> mapped = std::make_shared<FeatureSnapshot>();
+        if (mapped->map(path) && mapped->stamp() == updateTime)
+        {
+            snapshot = mapped;
+            return true;
+        }
+    }
+
+    std::map<uint64_t, std::map<Biterm, double>> bitermWeights;
+    if (!load(y, &bitermWeights))
         return false;
+    std::string bytes = FeatureSnapshot::encode(bitermWeights, updateTime);
+    std::shared_ptr<FeatureSnapshot> mySnapshot = std::make_shared<FeatureSnapshot>();
+    if (config.getSnapshots() && FeatureSnapshot::write(path, bytes) && mySnapshot->map(path))
+    {
+        snapshot = mySnapshot;
+        return true;
     }
+    if (!mySnapshot->assign(bytes))
+        return false;
+    snapshot = mySnapshot;
+    return true;
+}
+
+bool BitermWeight::save(int y, std::map<uint64_t, std::map<Biterm, double>> &bitermWeights)
+{
+    sqlite3 *db = _scope.partitionDb();
+    if (db == NULL)
+        return false;
+    int rc = SQLITE_OK;
     char *errorMessage = NULL;
 
     // step 1: create tables
@@ -152,39 +240,34 @@ bool BitermWeight::save(int y, std::map<uint64_t, std::map<std::string, double>>
         if (rc != SQLITE_OK)
         {
             logError(errorMessage);
-            sqlite3_close(db);
             return false;
         }
     }
 
     // step 2: save publication biterm weights
+    if (!_scope.dictionary()->save())
+        return false;
+    Transaction tx(db);
+    if (!tx.ok())
+        return false;
     std::string keywords = _scope.getKeywords();
-    if (bitermWeights.size() > 0)
     {
-        std::stringstream ss;
-        ss << "INSERT OR IGNORE INTO pub_scope_bws(id, scope_keywords, year, biterm_weights) VALUES ";
+        Statement stmt(_scope.preparePartition("INSERT OR IGNORE INTO pub_scope_bws(id, scope_keywords, year, biterm_weights) VALUES (?,?,?,?);"));
+        if (!stmt.ok())
+            return false;
         for (auto idToBW = bitermWeights.begin(); idToBW != bitermWeights.end(); idToBW++)
         {
-            if (idToBW != bitermWeights.begin())
-                ss << ",";
-            ss << "(" << idToBW->first << ",'" << keywords << "'," << y << ",'";
-            for (auto bToW = idToBW->second.begin(); bToW != idToBW->second.end(); bToW++)
+            stmt.bind(1, idToBW->first);
+            stmt.bind(2, keywords);
+            stmt.bind(3, y);
+            stmt.bindBlob(4, encodeBws(idToBW->second));
+            if (!stmt.execute())
             {
-                if (bToW != idToBW->second.begin())
-                    ss << ",";
-                ss << bToW->first << ":" << bToW->second;
+                logError(stmt.errorMessage());
+                return false;
             }
-            ss << "')";
-        }
-        ss << ";";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), NULL, NULL, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logError(errorMessage);
-            sqlite3_close(db);
-            return false;
+            if (!tx.step())
+                return false;
         }
     }
 
@@ -192,22 +275,36 @@ bool BitermWeight::save(int y, std::map<uint64_t, std::map<std::string, double>>
     {
         time_t t;
         time(&t);
-        std::stringstream ss;
-        ss << "INSERT OR IGNORE INTO scope_bw_tokens(keywords, year, update_time) VALUES ('"
-            << keywords << "'," << y << "," << (int)t << ");";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), NULL, NULL, &errorMessage);
-        if (rc != SQLITE_OK)
+        Statement stmt(_scope.preparePartition("INSERT OR IGNORE INTO scope_bw_tokens(keywords, year, update_time) VALUES (?,?,?);"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        stmt.bind(3, (int)t);
+        if (!stmt.execute())
         {
-            logError(errorMessage);
-            sqlite3_close(db);
+            logError(stmt.errorMessage());
             return false;
         }
     }
 
-    sqlite3_close(db);
-    return true;
+    // step 4: write the snapshot read by the later stages once the rows it mirrors are committed, which
+    // happens only with the batch of the write-behind writer the transaction joined
+    GeneralConfig config;
+    if (config.getSnapshots())
+    {
+        int64_t updateTime = 0;
+        if (getUpdateTime(y, updateTime))
+        {
+            std::string path = _scope.getSnapshotPath("bws", y);
+            std::shared_ptr<std::string> bytes = std::make_shared<std::string>(FeatureSnapshot::encode(bitermWeights, updateTime));
+            tx.onCommit([path, bytes]()
+                {
+                    FeatureSnapshot::write(path, *bytes);
+                });
+        }
+    }
+    return tx.commit();
 }
 
 bool BitermWeight::process(int y)
@@ -216,12 +313,12 @@ bool BitermWeight::process(int y)
         return true;
 
     // step 1: load tfirdfs
-    std::map<uint64_t, std::map<std::string, double>> tfirdfs;
+    std::map<uint64_t, std::map<uint32_t, double>> tfirdfs;
     if (!_tt->load(y, &tfirdfs, false))
         return false;
 
     // step 2: load bitermDfs
-    std::map<std::string, int> bdfs[10];
+    std::map<Biterm, int> bdfs[10];
     int numPubs = 0;
     for (int i = 0; i < 10; i++)
     {
@@ -293,7 +390,7 @@ bool BitermWeight::process(int y)
         return false;
 
     // step 4: compute biterm weights
-    std::map<uint64_t, std::map<std::string, double>> bitermWeights;
+    std::map<uint64_t, std::map<Biterm, double>> bitermWeights;
     for (auto idToWorkTfirdfs = tfirdfs.begin(); idToWorkTfirdfs != tfirdfs.end(); idToWorkTfirdfs++)
     {
         q.push(idToWorkTfirdfs->first);
@@ -321,7 +418,7 @@ bool BitermWeight::process(int y)
                         return;
                     double mean = meanTfirdfs[id];
 
-                    std::map<std::string, double> bwOfId;
+                    std::map<Biterm, double> bwOfId;
                     for (auto tToTf1 = idToTTf->second.begin(); tToTf1 != idToTTf->second.end(); tToTf1++)
                     {
                         if (tToTf1->second < mean)
@@ -332,7 +429,7 @@ bool BitermWeight::process(int y)
                                 continue;
                             if (tToTf1->first < tToTf2->first)
                             {
-                                std::string biterm = tToTf1->first + "&" + tToTf2->first;
+                                Biterm biterm = TermDictionary::biterm(tToTf1->first, tToTf2->first);
                                 std::vector<double> df(10);
                                 double sumDf = 0;
                                 for (int i = 0; i < 10; i++)
@@ -364,7 +461,7 @@ bool BitermWeight::process(int y)
 
                     {
                         std::lock_guard<std::mutex> lock(mq);
-                        bitermWeights[id] = bwOfId;
+                        bitermWeights[id].swap(bwOfId);
                     }
 
                     if (_cancelled.load() == true)
@@ -383,7 +480,12 @@ bool BitermWeight::process(int y)
     if (bitermWeights.size() < tfirdfs.size())
         return false;
 
-
-    save(y, bitermWeights);
+    // step 4: save biterm weights while the next year is weighted
+    auto results = std::make_shared<std::map<uint64_t, std::map<Biterm, double>>>();
+    results->swap(bitermWeights);
+    _scope.saveLater([this, y, results]()
+        {
+            return save(y, *results);
+        });
     return true;
 }
@@ -0,0 +1,145 @@
+#include "Blob.h"
+#include <cstring>
+
+BlobWriter::BlobWriter(uint8_t version)
+{
+    //ctor
+    _bytes.push_back((char)version);
+}
+
+BlobWriter::~BlobWriter()
+{
+    //dtor
+}
+
+// write 7 bits per byte, low bits first, with the high bit set on all but the last byte
+void BlobWriter::writeVarint(uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        _bytes.push_back((char)((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    _bytes.push_back((char)value);
+}
+
+void BlobWriter::writeString(const std::string &value)
+{
+    writeVarint(value.size());
+    _bytes.append(value);
+}
+
+void BlobWriter::writeDouble(double value)
+{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    for (int i = 0; i < 8; i++)
+    {
+        _bytes.push_back((char)(bits & 0xff));
+        bits >>= 8;
+    }
+}
+
+void BlobWriter::writeBytes(const void *data, size_t size)
+{
+    _bytes.append((const char *)data, size);
+}
+
+BlobReader::BlobReader(meta::util::string_view bytes, uint8_t version)
+{
+    //ctor
+    _p = (const unsigned char *)bytes.data();
+    _end = _p + bytes.size();
+    _ok = (_p != _end && *_p == version);
+    if (_ok)
+        _p++;
+}
+
+BlobReader::~BlobReader()
+{
+    //dtor
+}
+
+uint64_t BlobReader::readVarint()
+{
+    uint64_t value = 0;
+    for (int shift = 0; _ok && shift < 64; shift += 7)
+    {
+        if (_p == _end)
+            break;
+        unsigned char byte = *_p++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return value;
+    }
+    _ok = false;
+    return 0;
+}
+
+meta::util::string_view BlobReader::readString()
+{
+    uint64_t len = readVarint();
+    if (!_ok || len > (uint64_t)(_end - _p))
+    {
+        _ok = false;
+        return meta::util::string_view();
+    }
+    return readBytes(len);
+}
+
+meta::util::string_view BlobReader::readBytes(size_t size)
+{
+    if (!_ok || size > (size_t)(_end - _p))
+    {
+        _ok = false;
+        return meta::util::string_view();
+    }
+    meta::util::string_view value((const char *)_p, size);
+    _p += size;
+    return value;
+}
+
+double BlobReader::readDouble()
+{
+    if (!_ok || _end - _p < 8)
+    {
+        _ok = false;
+        return 0.0;
+    }
+    uint64_t bits = 0;
+    for (int i = 7; i >= 0; i--)
+    {
+        bits = (bits << 8) | _p[i];
+    }
+    _p += 8;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// encode a weight map as its size followed by each key and value
+std::string encodeWeights(const std::map<std::string, double> &weights)
+{
+    BlobWriter blob;
+    blob.writeVarint(weights.size());
+    for (auto keyToWeight = weights.begin(); keyToWeight != weights.end(); keyToWeight++)
+    {
+        blob.writeString(keyToWeight->first);
+        blob.writeDouble(keyToWeight->second);
+    }
+    return blob.bytes();
+}
+
+bool decodeWeights(meta::util::string_view bytes, std::map<std::string, double> &weights)
+{
+    BlobReader blob(bytes);
+    uint64_t n = blob.readVarint();
+    for (uint64_t i = 0; i < n && blob.ok(); i++)
+    {
+        meta::util::string_view key = blob.readString();
+        double weight = blob.readDouble();
+        if (blob.ok())
+            weights[key.to_string()] = weight;
+    }
+    return blob.ok() && blob.atEnd();
+}
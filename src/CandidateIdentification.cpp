@@ -1,7 +1,6 @@
 #include "CandidateIdentification.h"
 #include <../WESTSeerApp.h>
 #include <GeneralConfig.h>
-#include <CallbackData.h>
 #include <wxFFileLog.h>
 #include <StringProcessing.h>
 #include <ctime>
@@ -57,79 +56,61 @@ void CandidateIdentification::doStep(int stepId)
         process(_y2 + 5);
 }
 
-bool CandidateIdentification::load(int y, std::vector<uint64_t> *candidates)
+bool CandidateIdentification::flush()
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
-
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + path));
-        return false;
-    }
-    CallbackData data;
-    char *errorMessage = NULL;
+    return _scope.flush();
+}
 
+bool CandidateIdentification::load(int y, std::vector<uint64_t> *candidates)
+{
     // step 1: load scope candidates
     std::string keywords = _scope.getKeywords();
     if (candidates != NULL)
     {
         candidates->clear();
-        std::stringstream ss;
-        ss << "SELECT keywords, year, candidates FROM scope_candidates WHERE keywords = '"
-            << keywords << "' AND year = " << y << ";";
-        logDebug(ss.str().c_str());
-        rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
+        Statement stmt(_scope.preparePartition("SELECT candidates FROM scope_candidates WHERE keywords = ? AND year = ?;"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        if (!stmt.step())
         {
-            logDebug(errorMessage);
-            sqlite3_close(db);
+            if (!stmt.done())
+                logDebug(stmt.errorMessage());
             return false;
         }
-        if (data.results.size() > 0)
+        meta::util::string_view text = stmt.getText(0);
+        meta::util::string_view field;
+        while (nextField(text, ',', field))
         {
-            std::string strCandidates = data.results[0]["candidates"];
-            std::vector<std::string> fields = splitString(strCandidates, ",");
-            for (std::string field: fields)
-            {
-                candidates->push_back(std::stoull(field));
-            }
+            candidates->push_back(toUInt64(field));
         }
     }
     else
     {
-        std::stringstream ss;
-        ss << "SELECT keywords, year FROM scope_candidates WHERE keywords = '"
-            << keywords << "' AND year = " << y << ";";
-        logDebug(ss.str().c_str());
-        rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
+        Statement stmt(_scope.preparePartition("SELECT year FROM scope_candidates WHERE keywords = ? AND year = ?;"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        if (!stmt.step())
         {
-            logDebug(errorMessage);
-            sqlite3_close(db);
+            if (!stmt.done())
+                logDebug(stmt.errorMessage());
             return false;
         }
     }
 
 
-    sqlite3_close(db);
-    return (data.results.size() > 0);
+    return true;
 }
 
 bool CandidateIdentification::save(int y, const std::vector<uint64_t> &candidates)
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
-
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + path));
+    sqlite3 *db = _scope.partitionDb();
+    if (db == NULL)
         return false;
-    }
+    int rc = SQLITE_OK;
     char *errorMessage = NULL;
 
     // step 1: create tables
@@ -149,7 +130,6 @@ bool CandidateIdentification::save(int y, const std::vector<uint64_t> &candidate
         if (rc != SQLITE_OK)
         {
             logError(errorMessage);
-            sqlite3_close(db);
             return false;
         }
     }
@@ -160,26 +140,25 @@ bool CandidateIdentification::save(int y, const std::vector<uint64_t> &candidate
     time(&t);
     {
         std::stringstream ss;
-        ss << "INSERT OR IGNORE INTO scope_candidates(keywords, year, update_time, candidates) VALUES ('"
-            << keywords << "'," << y << "," << (int)t << ",'";
         for (auto iter = candidates.begin(); iter != candidates.end(); iter++)
         {
             if (iter != candidates.begin())
                 ss << ",";
             ss << *iter;
         }
-        ss << "');";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), NULL, NULL, &errorMessage);
-        if (rc != SQLITE_OK)
+        Statement stmt(_scope.preparePartition("INSERT OR IGNORE INTO scope_candidates(keywords, year, update_time, candidates) VALUES (?,?,?,?);"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        stmt.bind(3, (int)t);
+        stmt.bind(4, ss.str());
+        if (!stmt.execute())
         {
-            logError(errorMessage);
-            sqlite3_close(db);
+            logError(stmt.errorMessage());
             return false;
         }
     }
-    sqlite3_close(db);
     return true;
 }
 
@@ -188,7 +167,7 @@ bool CandidateIdentification::process(int y)
     std::map<uint64_t, int> refCounts;
     for (int i = 0; i < 10; i++)
     {
-        std::map<uint64_t, std::vector<uint64_t>> refIdsOfId;
+        std::shared_ptr<const RefIdsOfId> refIdsOfId;
         if (!_scope.getExistingRefIds(y - 6 - i, refIdsOfId))
         {
             continue;
@@ -198,7 +177,7 @@ bool CandidateIdentification::process(int y)
             return false;
         }
 
-        for (auto iter = refIdsOfId.begin(); iter != refIdsOfId.end(); iter++)
+        for (auto iter = refIdsOfId->begin(); iter != refIdsOfId->end(); iter++)
         {
             for (uint64_t refId: iter->second)
             {
@@ -234,6 +213,11 @@ bool CandidateIdentification::process(int y)
         return false;
     }
 
-    save(y, candidates);
+    auto results = std::make_shared<std::vector<uint64_t>>();
+    results->swap(candidates);
+    _scope.saveLater([this, y, results]()
+        {
+            return save(y, *results);
+        });
     return true;
 }
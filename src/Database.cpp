@@ -0,0 +1,178 @@
+#include "Database.h"
+#include <vector>
+#include <wxFFileLog.h>
+
+std::mutex Database::_registryMutex;
+std::map<std::pair<std::string, bool>, std::weak_ptr<Database>> Database::_registry;
+
+// the databases a thread has opened connections to, whose connections are released when the thread exits
+class ThreadConnections
+{
+    public:
+        ~ThreadConnections()
+        {
+            for (auto &database: _databases)
+            {
+                std::shared_ptr<Database> db = database.lock();
+                if (db)
+                    db->release();
+            }
+        }
+        void add(std::weak_ptr<Database> db)
+        {
+            if (!db.expired())
+                _databases.push_back(db);
+        }
+
+    private:
+        std::vector<std::weak_ptr<Database>> _databases;
+};
+
+static thread_local ThreadConnections threadConnections;
+
+Database::Database(const std::string path, bool readOnly)
+{
+    //ctor
+    _path = path;
+    _readOnly = readOnly;
+}
+
+Database::~Database()
+{
+    //dtor
+    for (auto &threadToConn: _connections)
+    {
+        close(threadToConn.second);
+    }
+    _connections.clear();
+}
+
+void Database::close(Connection &conn)
+{
+    for (auto &sqlToStmt: conn.statements)
+    {
+        sqlite3_finalize(sqlToStmt.second);
+    }
+    conn.statements.clear();
+    sqlite3_close(conn.db);
+    conn.db = NULL;
+}
+
+// close the connection of the calling thread, which the next use opens again
+void Database::release()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto threadToConn = _connections.find(std::this_thread::get_id());
+    if (threadToConn == _connections.end())
+        return;
+    close(threadToConn->second);
+    _connections.erase(threadToConn);
+}
+
+const std::string &Database::path() const
+{
+    return _path;
+}
+
+bool Database::readOnly() const
+{
+    return _readOnly;
+}
+
+// apply the connection profile: WAL journaling for writers, and for everyone a busy timeout
+// long enough to wait out a batch commit, memory-mapped reads and a larger page cache
+bool Database::configure(sqlite3 *db)
+{
+    sqlite3_busy_timeout(db, 30000);
+    std::string sql;
+    if (!_readOnly)
+        sql += "PRAGMA journal_mode=WAL;PRAGMA synchronous=NORMAL;";
+    sql += "PRAGMA mmap_size=268435456;PRAGMA cache_size=-65536;";
+    char *errorMessage = NULL;
+    logDebug(sql.c_str());
+    int rc = sqlite3_exec(db, sql.c_str(), NULL, NULL, &errorMessage);
+    if (rc != SQLITE_OK)
+    {
+        logError(errorMessage);
+        sqlite3_free(errorMessage);
+        return false;
+    }
+    return true;
+}
+
+// get the connection of the calling thread, opening it on first use; opening waits out other writers
+// for up to the busy timeout, so it is done without the lock that every thread needs for its lookups
+Database::Connection *Database::connection()
+{
+    std::thread::id tid = std::this_thread::get_id();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto threadToConn = _connections.find(tid);
+        if (threadToConn != _connections.end())
+            return &(threadToConn->second);
+    }
+
+    // every connection is used by its own thread only, so SQLite's mutexes are not needed
+    int flags = SQLITE_OPEN_NOMUTEX;
+    flags |= _readOnly ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+    sqlite3 *db = NULL;
+    int rc = sqlite3_open_v2(_path.c_str(), &db, flags, NULL);
+    if (rc != SQLITE_OK || !configure(db))
+    {
+        logError(wxT("Cannot open database at" + _path));
+        sqlite3_close(db);
+        return NULL;
+    }
+    threadConnections.add(weak_from_this());
+    std::lock_guard<std::mutex> lock(_mutex);
+    Connection &conn = _connections[tid];
+    conn.db = db;
+    return &conn;
+}
+
+sqlite3 *Database::handle()
+{
+    Connection *conn = connection();
+    return conn != NULL ? conn->db : NULL;
+}
+
+// get the prepared statement of the calling thread for the sql, compiling it on first use
+sqlite3_stmt *Database::prepare(const std::string &sql)
+{
+    Connection *conn = connection();
+    if (conn == NULL)
+        return NULL;
+
+    auto sqlToStmt = conn->statements.find(sql);
+    if (sqlToStmt != conn->statements.end())
+        return sqlToStmt->second;
+
+    logDebug(sql.c_str());
+    sqlite3_stmt *stmt = NULL;
+    int rc = sqlite3_prepare_v2(conn->db, sql.c_str(), (int)sql.size(), &stmt, NULL);
+    if (rc != SQLITE_OK)
+    {
+        logDebug(sqlite3_errmsg(conn->db));
+        sqlite3_finalize(stmt);
+        return NULL;
+    }
+    conn->statements[sql] = stmt;
+    return stmt;
+}
+
+// get the database shared by all users of the same path and mode, creating it if nobody holds it
+std::shared_ptr<Database> Database::open(const std::string path, bool readOnly)
+{
+    std::lock_guard<std::mutex> lock(_registryMutex);
+    std::pair<std::string, bool> key(path, readOnly);
+    auto pathToDb = _registry.find(key);
+    if (pathToDb != _registry.end())
+    {
+        std::shared_ptr<Database> db = pathToDb->second.lock();
+        if (db)
+            return db;
+    }
+    std::shared_ptr<Database> db = std::make_shared<Database>(path, readOnly);
+    _registry[key] = db;
+    return db;
+}
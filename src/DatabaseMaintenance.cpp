@@ -0,0 +1,642 @@
+#include "DatabaseMaintenance.h"
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <Database.h>
+#include <Statement.h>
+#include <Transaction.h>
+#include <ResearchScope.h>
+#include <ReferenceCache.h>
+#include <TermDictionary.h>
+#include <GeneralConfig.h>
+#include <wxFFileLog.h>
+
+// a table written by one stage of the pipeline, the column holding the keywords of its scope,
+// and the sum of the lengths of its text and blob columns
+struct StageTable
+{
+    const char *name;
+    const char *keywordsColumn;
+    const char *size;
+};
+
+static const StageTable STAGE_TABLES[] =
+{
+    {"scope_term_dict", "keywords", "TOTAL(length(stem))+TOTAL(length(surface))"},
+    {"scope_terms", "keywords", "TOTAL(length(terms))"},
+    {"pub_scope_terms", "scope_keywords", "TOTAL(length(terms))"},
+    {"scope_dfs", "keywords", "TOTAL(length(dfs))"},
+    {"pub_scope_tfirdfs", "scope_keywords", "TOTAL(length(tfirdfs))"},
+    {"scope_bdfs", "keywords", "TOTAL(length(bdfs))"},
+    {"pub_scope_bws", "scope_keywords", "TOTAL(length(biterm_weights))"},
+    {"scope_bw_tokens", "keywords", "0"},
+    {"scope_candidates", "keywords", "TOTAL(length(candidates))"},
+    {"pub_scope_topics", "scope_keywords", "TOTAL(length(topic))"},
+    {"scope_topic_token", "keywords", "0"},
+    {"pub_scope_time_series", "scope_keywords", "TOTAL(length(plm))+TOTAL(length(prm))+TOTAL(length(slm))+TOTAL(length(srm))"},
+    {"scope_time_series_token", "keywords", "0"},
+    {"pub_scope_prediction", "scope_keywords", "TOTAL(length(prm))+TOTAL(length(srm))"},
+    {"scope_prediction_token", "keywords", "TOTAL(length(loss))"},
+    {"scope_metric", "keywords", "TOTAL(length(scores))"},
+};
+
+DatabaseMaintenance::DatabaseMaintenance(const std::string path, const std::vector<std::string> removedKeywords)
+{
+    //ctor
+    _path = path;
+    _removedKeywords = removedKeywords;
+}
+
+DatabaseMaintenance::~DatabaseMaintenance()
+{
+    //dtor
+}
+
+bool DatabaseMaintenance::finished()
+{
+    return false;
+}
+
+const char *DatabaseMaintenance::name()
+{
+    return "Database Maintenance";
+}
+
+int DatabaseMaintenance::numSteps()
+{
+    return 5;
+}
+
+void DatabaseMaintenance::doStep(int stepId)
+{
+    switch (stepId)
+    {
+    case 0:
+        {
+            if (!getFootprints(_footprints))
+                return;
+            for (ScopeFootprint &footprint: _footprints)
+            {
+                logMessage("Scope %s%s%s: %lld rows, %lld bytes, %lld rows in the shared database.", footprint.keywords.c_str(),
+                    footprint.abandoned ? " (abandoned)" : "", footprint.partitioned ? " (partitioned)" : "",
+                    (long long)footprint.numRows, (long long)footprint.numBytes, (long long)footprint.numSharedRows);
+            }
+        }
+        break;
+
+    case 1:
+        {
+            for (const std::string &keywords: _removedKeywords)
+            {
+                if (!forgetScope(keywords) || !dropScope(keywords))
+                    return;
+            }
+            for (ScopeFootprint &footprint: _footprints)
+            {
+                if (footprint.abandoned && !dropScope(footprint.keywords))
+                    return;
+            }
+        }
+        break;
+
+    case 2:
+        {
+            GeneralConfig config;
+            if (!config.getPartitions())
+                return;
+            for (ScopeFootprint &footprint: _footprints)
+            {
+                if (!footprint.abandoned && footprint.numSharedRows > 0 && !movePartition(footprint.keywords))
+                    return;
+            }
+        }
+        break;
+
+    case 3:
+        {
+            int64_t numPruned = 0;
+            if (prunePublications(numPruned))
+                logMessage("Pruned %lld publications no research scope refers to.", (long long)numPruned);
+        }
+        break;
+
+    case 4:
+        vacuum();
+        break;
+    }
+}
+
+// get the rows and bytes every scope owns in the stage tables, in the order of research_scopes followed by abandoned scopes
+bool DatabaseMaintenance::getFootprints(std::vector<ScopeFootprint> &footprints)
+{
+    footprints.clear();
+    std::map<std::string, ScopeFootprint> footprintOfKeywords;
+    if (!addFootprints(Database::open(_path), true, footprintOfKeywords))
+        return false;
+
+    for (const std::string &keywords: ResearchScope::getResearchScopes(_path))
+    {
+        std::string partitionPath = ResearchScope::getPartitionPath(_path, keywords);
+        std::ifstream partitionFile(partitionPath.c_str());
+        bool partitioned = partitionFile.good();
+        partitionFile.close();
+        if (partitioned && !addFootprints(Database::open(partitionPath, true), false, footprintOfKeywords))
+            return false;
+        auto kwsToFootprint = footprintOfKeywords.find(keywords);
+        if (kwsToFootprint == footprintOfKeywords.end())
+        {
+            ScopeFootprint footprint = {keywords, 0, 0, 0, false, false};
+            footprints.push_back(footprint);
+        }
+        else
+        {
+            kwsToFootprint->second.abandoned = false;
+            footprints.push_back(kwsToFootprint->second);
+            footprintOfKeywords.erase(kwsToFootprint);
+        }
+        footprints.back().partitioned = partitioned;
+    }
+    for (auto &kwsToFootprint: footprintOfKeywords)
+    {
+        footprints.push_back(kwsToFootprint.second);
+    }
+    return true;
+}
+
+// add up the rows and bytes of every scope in the stage tables of the shared database or of a partition
+bool DatabaseMaintenance::addFootprints(std::shared_ptr<Database> db, bool shared, std::map<std::string, ScopeFootprint> &footprintOfKeywords)
+{
+    for (const StageTable &table: STAGE_TABLES)
+    {
+        std::stringstream ss;
+        ss << "SELECT " << table.keywordsColumn << ", COUNT(*), " << table.size
+            << " FROM " << table.name << " GROUP BY " << table.keywordsColumn << ";";
+        Statement stmt(db->prepare(ss.str()));
+        if (!stmt.ok())
+            continue; // the stage has never run
+        while (stmt.step())
+        {
+            std::string keywords = stmt.getString(0);
+            auto kwsToFootprint = footprintOfKeywords.find(keywords);
+            if (kwsToFootprint == footprintOfKeywords.end())
+            {
+                ScopeFootprint footprint = {keywords, 0, 0, 0, true, false};
+                kwsToFootprint = footprintOfKeywords.insert(std::make_pair(keywords, footprint)).first;
+            }
+            kwsToFootprint->second.numRows += stmt.getInt64(1);
+            kwsToFootprint->second.numBytes += stmt.getInt64(2);
+            if (shared)
+                kwsToFootprint->second.numSharedRows += stmt.getInt64(1);
+        }
+        if (!stmt.done())
+        {
+            logError("%s", stmt.errorMessage());
+            return false;
+        }
+    }
+    return true;
+}
+
+// delete everything the stages derived for a scope, so that a later run analyses its publications again
+bool DatabaseMaintenance::dropScope(const std::string &keywords)
+{
+    // step 1: remove the files named after the years the tokens record
+    removeSnapshots(keywords);
+
+    // step 2: delete the rows left in the shared database
+    if (!deleteRows(Database::open(_path), keywords))
+        return false;
+
+    // step 3: delete the partition file, or its rows if it is still open somewhere
+    std::string partitionPath = ResearchScope::getPartitionPath(_path, keywords);
+    std::ifstream partitionFile(partitionPath.c_str());
+    if (partitionFile.good())
+    {
+        partitionFile.close();
+        if (std::remove(partitionPath.c_str()) == 0)
+        {
+            std::remove((partitionPath + "-wal").c_str());
+            std::remove((partitionPath + "-shm").c_str());
+        }
+        else if (!deleteRows(Database::open(partitionPath), keywords))
+            return false;
+    }
+
+    // step 4: make a dictionary still held by the GUI write its terms again
+    TermDictionary::invalidate(partitionPath, keywords);
+    TermDictionary::invalidate(_path, keywords);
+    logMessage("Dropped the derived rows of scope %s.", keywords.c_str());
+    return true;
+}
+
+// move the rows of a scope analysed before partitions were turned on from the shared database into its own file
+bool DatabaseMaintenance::movePartition(const std::string &keywords)
+{
+    std::shared_ptr<Database> db = Database::open(_path);
+    sqlite3 *handle = db->handle();
+    if (handle == NULL)
+        return false;
+
+    // step 1: copy the rows into a new file, unless an earlier run got as far as renaming it
+    std::string partitionPath = ResearchScope::getPartitionPath(_path, keywords);
+    std::ifstream partitionFile(partitionPath.c_str());
+    if (!partitionFile.good())
+    {
+        std::string tmpPath = partitionPath + ".tmp";
+        std::remove(tmpPath.c_str());
+        if (!copyRows(keywords, tmpPath))
+        {
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+        if (std::rename(tmpPath.c_str(), partitionPath.c_str()) != 0)
+        {
+            logError("Cannot rename %s.", tmpPath.c_str());
+            std::remove(tmpPath.c_str());
+            return false;
+        }
+    }
+    partitionFile.close();
+
+    // step 2: delete them from the shared database, where the scope no longer looks for them
+    if (!deleteRows(db, keywords))
+        return false;
+    logMessage("Moved the derived rows of scope %s to %s.", keywords.c_str(), partitionPath.c_str());
+    return true;
+}
+
+// copy the stage tables and the rows of a scope from the shared database into a new file
+bool DatabaseMaintenance::copyRows(const std::string &keywords, const std::string &partitionPath)
+{
+    std::shared_ptr<Database> db = Database::open(_path);
+    sqlite3 *handle = db->handle();
+    if (handle == NULL)
+        return false;
+
+    // step 1: create the tables and indexes with the statements that created them in the shared database
+    {
+        std::shared_ptr<Database> partition = Database::open(partitionPath);
+        sqlite3 *partitionHandle = partition->handle();
+        if (partitionHandle == NULL)
+            return false;
+        for (const StageTable &table: STAGE_TABLES)
+        {
+            Statement stmt(db->prepare("SELECT sql FROM sqlite_master WHERE tbl_name = ? AND sql IS NOT NULL ORDER BY type DESC;"));
+            if (!stmt.ok())
+                return false;
+            stmt.bind(1, std::string(table.name));
+            while (stmt.step())
+            {
+                char *errorMessage = NULL;
+                std::string sql = stmt.getString(0);
+                logDebug("%s", sql.c_str());
+                if (sqlite3_exec(partitionHandle, sql.c_str(), NULL, NULL, &errorMessage) != SQLITE_OK)
+                {
+                    logError("%s", errorMessage);
+                    sqlite3_free(errorMessage);
+                    return false;
+                }
+            }
+            if (!stmt.done())
+            {
+                logError("%s", stmt.errorMessage());
+                return false;
+            }
+        }
+    } // close the file, so that the attached connection is the only one writing it
+
+    // step 2: copy the rows through the connection of the shared database
+    {
+        Statement stmt(db->prepare("ATTACH DATABASE ? AS scope_partition;"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, partitionPath);
+        if (!stmt.execute())
+        {
+            logError("%s", stmt.errorMessage());
+            return false;
+        }
+    }
+    bool copied = true;
+    {
+        Transaction tx(handle);
+        copied = tx.ok();
+        for (const StageTable &table: STAGE_TABLES)
+        {
+            if (!copied)
+                break;
+            std::stringstream ss;
+            ss << "INSERT OR IGNORE INTO scope_partition." << table.name << " SELECT * FROM main." << table.name
+                << " WHERE " << table.keywordsColumn << " = ?;";
+            Statement stmt(db->prepare(ss.str()));
+            if (!stmt.ok())
+                continue; // the stage has never run
+            stmt.bind(1, keywords);
+            if (!stmt.execute())
+            {
+                logError("%s", stmt.errorMessage());
+                copied = false;
+            }
+        }
+        copied = copied && tx.commit();
+    }
+    return execute("DETACH DATABASE scope_partition;") && copied;
+}
+
+// delete the rows of a scope from every stage table of a database
+bool DatabaseMaintenance::deleteRows(std::shared_ptr<Database> db, const std::string &keywords)
+{
+    sqlite3 *handle = db->handle();
+    if (handle == NULL)
+        return false;
+    Transaction tx(handle);
+    if (!tx.ok())
+        return false;
+    for (const StageTable &table: STAGE_TABLES)
+    {
+        std::stringstream ss;
+        ss << "DELETE FROM " << table.name << " WHERE " << table.keywordsColumn << " = ?;";
+        Statement stmt(db->prepare(ss.str()));
+        if (!stmt.ok())
+            continue;
+        stmt.bind(1, keywords);
+        if (!stmt.execute())
+        {
+            logError("%s", stmt.errorMessage());
+            return false;
+        }
+    }
+    return tx.commit();
+}
+
+// delete a scope from research_scopes together with the queries of the combinations no other scope shares
+bool DatabaseMaintenance::forgetScope(const std::string &keywords)
+{
+    // step 1: find the combinations only this scope queried
+    std::set<std::string> combinations;
+    try
+    {
+        ResearchScope scope(_path, keywords, true);
+        for (int i = 0; i < scope.numCombinations(); i++)
+        {
+            combinations.insert(scope.getCombination(i));
+        }
+        for (const std::string &otherKeywords: ResearchScope::getResearchScopes(_path))
+        {
+            if (otherKeywords == keywords)
+                continue;
+            ResearchScope other(_path, otherKeywords, true);
+            for (int i = 0; i < other.numCombinations(); i++)
+            {
+                combinations.erase(other.getCombination(i));
+            }
+        }
+    }
+    catch (std::invalid_argument &e)
+    {
+        logError("Cannot parse the keywords of scope %s.", keywords.c_str());
+        return false;
+    }
+
+    std::shared_ptr<Database> db = Database::open(_path);
+    sqlite3 *handle = db->handle();
+    if (handle == NULL)
+        return false;
+    Transaction tx(handle);
+    if (!tx.ok())
+        return false;
+
+    // step 2: delete the memberships, crawl checkpoints and tokens of those combinations
+    const char *combinationIdSqls[] =
+    {
+        "DELETE FROM openalex_query_works WHERE combination_id = ?;",
+        "DELETE FROM openalex_query_refs WHERE combination_id = ?;",
+        "DELETE FROM openalex_cursors WHERE combination_id = ?;",
+        "DELETE FROM openalex_combinations WHERE id = ?;",
+    };
+    const char *combinationSqls[] =
+    {
+        "DELETE FROM openalex_queries WHERE combination = ?;",
+        "DELETE FROM openalex_tokens WHERE combination = ?;",
+    };
+    for (const std::string &combination: combinations)
+    {
+        int64_t combinationId = 0;
+        {
+            Statement stmt(db->prepare("SELECT id FROM openalex_combinations WHERE combination = ?;"));
+            if (!stmt.ok())
+                return false;
+            stmt.bind(1, combination);
+            if (stmt.step())
+                combinationId = stmt.getInt64(0);
+            else if (!stmt.done())
+            {
+                logError("%s", stmt.errorMessage());
+                return false;
+            }
+        }
+        for (const char *sql: combinationIdSqls)
+        {
+            if (combinationId == 0)
+                break;
+            // openalex_cursors is missing from databases no crawl of this version has written to
+            Statement stmt(db->prepare(sql));
+            if (!stmt.ok())
+                continue;
+            stmt.bind(1, combinationId);
+            if (!stmt.execute())
+            {
+                logError("%s", stmt.errorMessage());
+                return false;
+            }
+        }
+        for (const char *sql: combinationSqls)
+        {
+            Statement stmt(db->prepare(sql));
+            if (!stmt.ok())
+                return false;
+            stmt.bind(1, combination);
+            if (!stmt.execute())
+            {
+                logError("%s", stmt.errorMessage());
+                return false;
+            }
+        }
+    }
+
+    // step 3: delete the scope itself
+    {
+        Statement stmt(db->prepare("DELETE FROM research_scopes WHERE keywords = ?;"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, keywords);
+        if (!stmt.execute())
+        {
+            logError("%s", stmt.errorMessage());
+            return false;
+        }
+    }
+    if (!tx.commit())
+        return false;
+    ReferenceCache::open(_path, keywords)->clear();
+    logMessage("Removed scope %s and %d combinations only it queried.", keywords.c_str(), (int)combinations.size());
+    return true;
+}
+
+// delete the publications that are neither a work nor a reference of any remaining query, with their citations and tokens
+bool DatabaseMaintenance::prunePublications(int64_t &numPruned)
+{
+    numPruned = 0;
+    std::shared_ptr<Database> db = Database::open(_path);
+    sqlite3 *handle = db->handle();
+    if (handle == NULL)
+        return false;
+    Transaction tx(handle);
+    if (!tx.ok())
+        return false;
+
+    const char *sqls[] =
+    {
+        "DELETE FROM publications WHERE"
+        " NOT EXISTS (SELECT 1 FROM openalex_query_works WHERE work_id = publications.id) AND"
+        " NOT EXISTS (SELECT 1 FROM openalex_query_refs WHERE ref_id = publications.id);",
+
+        "DELETE FROM citations WHERE citing_id NOT IN (SELECT id FROM publications);",
+
+        "DELETE FROM pub_tokens WHERE id NOT IN (SELECT id FROM publications);",
+    };
+    for (size_t i = 0; i < sizeof(sqls) / sizeof(sqls[0]); i++)
+    {
+        Statement stmt(db->prepare(sqls[i]));
+        if (!stmt.ok())
+            return false;
+        if (!stmt.execute())
+        {
+            logError("%s", stmt.errorMessage());
+            return false;
+        }
+        if (i == 0)
+            numPruned = sqlite3_changes(handle);
+    }
+    return tx.commit();
+}
+
+// give free pages back to the file system, converting the database to incremental auto-vacuum the first time
+bool DatabaseMaintenance::vacuum()
+{
+    std::shared_ptr<Database> db = Database::open(_path);
+    int64_t pragmas[2] = {0, 0};
+    const char *pragmaSqls[] = {"PRAGMA auto_vacuum;", "PRAGMA freelist_count;"};
+    for (int i = 0; i < 2; i++)
+    {
+        Statement stmt(db->prepare(pragmaSqls[i]));
+        if (!stmt.ok())
+            return false;
+        if (!stmt.step())
+        {
+            logError("%s", stmt.errorMessage());
+            return false;
+        }
+        pragmas[i] = stmt.getInt64(0);
+    }
+    int autoVacuum = (int)pragmas[0];
+    int64_t numFreePages = pragmas[1];
+
+    // step 1: a database only becomes incremental after it is rebuilt once
+    if (autoVacuum != 2)
+    {
+        logMessage("Converting the database to incremental vacuum, which rewrites the whole file once.");
+        if (!execute("PRAGMA auto_vacuum = INCREMENTAL;") || !execute("VACUUM;"))
+            return false;
+    }
+    // step 2: release the pages freed since the last maintenance
+    else
+    {
+        logMessage("Releasing %lld free pages.", (long long)numFreePages);
+        if (!execute("PRAGMA incremental_vacuum;"))
+            return false;
+    }
+
+    // step 3: shrink the write-ahead log, which grows with the deletes
+    return execute("PRAGMA wal_checkpoint(TRUNCATE);");
+}
+
+bool DatabaseMaintenance::getYears(std::shared_ptr<Database> db, const char *sql, const std::string &keywords, std::set<int> &years)
+{
+    Statement stmt(db->prepare(sql));
+    if (!stmt.ok())
+        return false;
+    stmt.bind(1, keywords);
+    while (stmt.step())
+    {
+        years.insert(stmt.getInt(0));
+    }
+    if (!stmt.done())
+    {
+        logError("%s", stmt.errorMessage());
+        return false;
+    }
+    return true;
+}
+
+// remove the biterm weight snapshots and model checkpoints of a scope, which live next to the database
+bool DatabaseMaintenance::removeSnapshots(const std::string &keywords)
+{
+    std::set<int> bwYears;
+    std::set<int> lstmYears;
+    try
+    {
+        ResearchScope scope(_path, keywords, true);
+        std::vector<std::shared_ptr<Database>> dbs;
+        dbs.push_back(Database::open(_path, true));
+        std::string partitionPath = ResearchScope::getPartitionPath(_path, keywords);
+        std::ifstream partitionFile(partitionPath.c_str());
+        if (partitionFile.good())
+            dbs.push_back(Database::open(partitionPath, true));
+        for (std::shared_ptr<Database> db: dbs)
+        {
+            getYears(db, "SELECT year FROM scope_bw_tokens WHERE keywords = ?;", keywords, bwYears);
+            getYears(db, "SELECT year FROM scope_prediction_token WHERE keywords = ?;", keywords, lstmYears);
+        }
+        for (int y: bwYears)
+        {
+            std::remove(scope.getSnapshotPath("bws", y).c_str());
+        }
+
+        // checkpoints are named after the number of biterms per topic, so only those of the current setting are found
+        GeneralConfig config;
+        std::stringstream ss;
+        ss << "lstm_" << config.getBiterms();
+        for (int y: lstmYears)
+        {
+            std::string prefix = scope.getSnapshotPath(ss.str(), y);
+            std::remove((prefix + ".index").c_str());
+            std::remove((prefix + ".data-00000-of-00001").c_str());
+        }
+    }
+    catch (std::invalid_argument &e)
+    {
+        return false;
+    }
+    return true;
+}
+
+bool DatabaseMaintenance::execute(const char *sql)
+{
+    std::shared_ptr<Database> db = Database::open(_path);
+    sqlite3 *handle = db->handle();
+    if (handle == NULL)
+        return false;
+    char *errorMessage = NULL;
+    logDebug("%s", sql);
+    int rc = sqlite3_exec(handle, sql, NULL, NULL, &errorMessage);
+    if (rc != SQLITE_OK)
+    {
+        logError("%s", errorMessage);
+        sqlite3_free(errorMessage);
+        return false;
+    }
+    return true;
+}
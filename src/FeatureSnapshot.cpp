@@ -0,0 +1,213 @@
+#include "FeatureSnapshot.h"
+#include <wxFFileLog.h>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const char MAGIC[4] = {'W', 'S', 'F', 'S'};
+static const uint32_t VERSION = 1;
+
+FeatureSnapshot::FeatureSnapshot()
+{
+    //ctor
+    _view = NULL;
+    _viewSize = 0;
+    _header = NULL;
+    _ids = NULL;
+    _offsets = NULL;
+    _keys = NULL;
+    _values = NULL;
+}
+
+FeatureSnapshot::~FeatureSnapshot()
+{
+    //dtor
+    unmap();
+}
+
+void FeatureSnapshot::unmap()
+{
+    if (_view == NULL)
+        return;
+#if defined(_WIN32)
+    UnmapViewOfFile(_view);
+#else
+    munmap(_view, _viewSize);
+#endif
+    _view = NULL;
+    _viewSize = 0;
+    _header = NULL;
+}
+
+// map a snapshot file into memory, returning false if it is missing or not a valid snapshot
+bool FeatureSnapshot::map(const std::string &path)
+{
+    unmap();
+    _bytes.clear();
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(Header))
+    {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        return false;
+    // the view keeps the mapping alive after its handle is closed
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (view == NULL)
+        return false;
+    size_t size = (size_t)fileSize.QuadPart;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(Header))
+    {
+        close(fd);
+        return false;
+    }
+    size_t size = (size_t)st.st_size;
+    void *view = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED)
+        return false;
+#endif
+    _view = view;
+    _viewSize = size;
+    if (!attach((const char *)view, size))
+    {
+        logDebug("Invalid feature snapshot %s", path.c_str());
+        unmap();
+        return false;
+    }
+    return true;
+}
+
+// take over encoded bytes, for when snapshot files are disabled or cannot be written
+bool FeatureSnapshot::assign(std::string &bytes)
+{
+    unmap();
+    _bytes.swap(bytes);
+    return attach(_bytes.data(), _bytes.size());
+}
+
+// point the arrays into the snapshot after checking that its header matches its size
+bool FeatureSnapshot::attach(const char *data, size_t size)
+{
+    _header = NULL;
+    if (size < sizeof(Header))
+        return false;
+    const Header *header = (const Header *)data;
+    if (memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != VERSION)
+        return false;
+    uint64_t numWords = 2 * header->numRows + 1 + 2 * header->numEntries;
+    if ((size - sizeof(Header)) / sizeof(uint64_t) != numWords || (size - sizeof(Header)) % sizeof(uint64_t) != 0)
+        return false;
+    _ids = (const uint64_t *)(data + sizeof(Header));
+    _offsets = _ids + header->numRows;
+    _keys = _offsets + header->numRows + 1;
+    _values = (const double *)(_keys + header->numEntries);
+    if (_offsets[header->numRows] != header->numEntries)
+        return false;
+    _header = header;
+    return true;
+}
+
+int64_t FeatureSnapshot::stamp() const
+{
+    return _header != NULL ? _header->stamp : 0;
+}
+
+size_t FeatureSnapshot::numRows() const
+{
+    return _header != NULL ? (size_t)_header->numRows : 0;
+}
+
+// get the row of a publication by binary search, or npos if it has no row
+size_t FeatureSnapshot::find(uint64_t id) const
+{
+    size_t n = numRows();
+    const uint64_t *idToRow = std::lower_bound(_ids, _ids + n, id);
+    if (idToRow == _ids + n || *idToRow != id)
+        return npos;
+    return (size_t)(idToRow - _ids);
+}
+
+std::string FeatureSnapshot::encode(const std::map<uint64_t, std::map<uint64_t, double>> &rows, int64_t stamp)
+{
+    Header header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.stamp = stamp;
+    header.numRows = rows.size();
+    header.numEntries = 0;
+    for (auto &idToRow: rows)
+    {
+        header.numEntries += idToRow.second.size();
+    }
+
+    std::string bytes;
+    bytes.resize(sizeof(Header) + (2 * header.numRows + 1 + 2 * header.numEntries) * sizeof(uint64_t));
+    char *data = &bytes[0];
+    memcpy(data, &header, sizeof(Header));
+    uint64_t *ids = (uint64_t *)(data + sizeof(Header));
+    uint64_t *offsets = ids + header.numRows;
+    uint64_t *keys = offsets + header.numRows + 1;
+    double *values = (double *)(keys + header.numEntries);
+    uint64_t offset = 0;
+    for (auto &idToRow: rows)
+    {
+        *ids++ = idToRow.first;
+        *offsets++ = offset;
+        for (auto &keyToValue: idToRow.second)
+        {
+            keys[offset] = keyToValue.first;
+            values[offset] = keyToValue.second;
+            offset++;
+        }
+    }
+    *offsets = offset;
+    return bytes;
+}
+
+// write a snapshot file next to the old one and then replace it, so that readers never map a partial file
+bool FeatureSnapshot::write(const std::string &path, const std::string &bytes)
+{
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream out(tmpPath.c_str(), std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), bytes.size());
+        out.close();
+        if (!out)
+        {
+            std::remove(tmpPath.c_str());
+            logError("Cannot write feature snapshot %s", tmpPath.c_str());
+            return false;
+        }
+    }
+    std::remove(path.c_str());
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        logDebug("Cannot replace feature snapshot %s", path.c_str());
+        std::remove(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
@@ -20,6 +20,16 @@ GeneralConfig::GeneralConfig()
     config->Read("TFIRDF", &_tfirdf);
     _citations = 20;
     config->Read("Citations", &_citations);
+    _snapshots = true;
+    config->Read("Snapshots", &_snapshots);
+    _partitions = true;
+    config->Read("Partitions", &_partitions);
+    wxString server = config->Read("Server", "https://api.openalex.org");
+    _server = server.ToStdString();
+    _requestsPerSecond = 10;
+    config->Read("RequestsPerSecond", &_requestsPerSecond);
+    _connections = 4;
+    config->Read("Connections", &_connections);
 }
 
 GeneralConfig::~GeneralConfig()
@@ -77,6 +87,47 @@ void GeneralConfig::setCitations(int value)
     config->Write("Citations", _citations);
 }
 
+void GeneralConfig::setSnapshots(bool value)
+{
+    _snapshots = value;
+    wxFileConfig *config = WESTSeerApp::getFileConfig();
+    config->SetPath("/General");
+    config->Write("Snapshots", _snapshots);
+}
+
+void GeneralConfig::setPartitions(bool value)
+{
+    _partitions = value;
+    wxFileConfig *config = WESTSeerApp::getFileConfig();
+    config->SetPath("/General");
+    config->Write("Partitions", _partitions);
+}
+
+void GeneralConfig::setServer(std::string value)
+{
+    _server = value;
+    wxFileConfig *config = WESTSeerApp::getFileConfig();
+    config->SetPath("/General");
+    wxString server(_server);
+    config->Write("Server", server);
+}
+
+void GeneralConfig::setRequestsPerSecond(int value)
+{
+    _requestsPerSecond = value;
+    wxFileConfig *config = WESTSeerApp::getFileConfig();
+    config->SetPath("/General");
+    config->Write("RequestsPerSecond", _requestsPerSecond);
+}
+
+void GeneralConfig::setConnections(int value)
+{
+    _connections = value;
+    wxFileConfig *config = WESTSeerApp::getFileConfig();
+    config->SetPath("/General");
+    config->Write("Connections", _connections);
+}
+
 const std::string GeneralConfig::getLogFile()
 {
     wxString appDir = wxStandardPaths::Get().GetUserLocalDataDir();
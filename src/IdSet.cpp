@@ -0,0 +1,71 @@
+#include "IdSet.h"
+#include <Statement.h>
+#include <wxFFileLog.h>
+
+IdSet::IdSet(std::shared_ptr<Database> db, const std::string name)
+{
+    //ctor
+    _db = db;
+    _table = "temp." + name;
+    _insert = NULL;
+    _owner = false;
+    _ok = execute("CREATE TEMP TABLE IF NOT EXISTS " + name + "(id INTEGER PRIMARY KEY);");
+}
+
+IdSet::~IdSet()
+{
+    //dtor
+    if (_ok)
+        execute("DELETE FROM " + _table + ";");
+}
+
+// open a transaction for the inserts unless the connection is in one already, which only locks the temporary database
+bool IdSet::begin()
+{
+    if (!_ok)
+        return false;
+    _insert = _db->prepare("INSERT OR IGNORE INTO " + _table + "(id) VALUES (?);");
+    if (_insert == NULL)
+        return false;
+    sqlite3 *handle = _db->handle();
+    _owner = sqlite3_get_autocommit(handle) != 0;
+    return !_owner || execute("BEGIN;");
+}
+
+bool IdSet::insert(uint64_t id)
+{
+    Statement stmt(_insert);
+    stmt.bind(1, id);
+    if (!stmt.execute())
+    {
+        logError("%s", stmt.errorMessage());
+        return false;
+    }
+    return true;
+}
+
+bool IdSet::end(bool commit)
+{
+    _insert = NULL;
+    if (!_owner)
+        return commit;
+    _owner = false;
+    return execute(commit ? "COMMIT;" : "ROLLBACK;") && commit;
+}
+
+bool IdSet::execute(const std::string &sql)
+{
+    sqlite3 *handle = _db->handle();
+    if (handle == NULL)
+        return false;
+    char *errorMessage = NULL;
+    logDebug("%s", sql.c_str());
+    int rc = sqlite3_exec(handle, sql.c_str(), NULL, NULL, &errorMessage);
+    if (rc != SQLITE_OK)
+    {
+        logError("%s", errorMessage);
+        sqlite3_free(errorMessage);
+        return false;
+    }
+    return true;
+}
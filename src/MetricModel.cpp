@@ -1,13 +1,13 @@
 #include "MetricModel.h"
 #include <../WESTSeerApp.h>
 #include <GeneralConfig.h>
-#include <CallbackData.h>
 #include <wxFFileLog.h>
 #include <StringProcessing.h>
 #include <ctime>
 #include <cstdlib>
 #include <sstream>
 #include <set>
+#include <algorithm>
 
 MetricModel::MetricModel(const std::string path, const std::string kws, TimeSeriesExtraction *tse, PredictionModel *pm):_scope(path, kws)
 {
@@ -48,6 +48,11 @@ void MetricModel::doStep(int stepId)
         process(_y2 + 5);
 }
 
+bool MetricModel::flush()
+{
+    return _scope.flush();
+}
+
 std::string getScoreStr(const std::map<uint64_t, std::vector<double>> &scores)
 {
     std::stringstream ss;
@@ -60,92 +65,65 @@ std::string getScoreStr(const std::map<uint64_t, std::vector<double>> &scores)
     return ss.str();
 }
 
-std::map<uint64_t, std::vector<double>> getScores(std::string scoreStr)
+std::map<uint64_t, std::vector<double>> getScores(meta::util::string_view scoreStr)
 {
-    std::vector<std::string> idScoreStrs = splitString(scoreStr,";");
     std::map<uint64_t, std::vector<double>> scores;
-    for (std::string s: idScoreStrs)
+    meta::util::string_view idScoreStr, strId, v;
+    while (nextField(scoreStr, ';', idScoreStr))
     {
-        std::vector<std::string> fields = splitString(s,":");
-        uint64_t id = std::stoull(fields[0]);
-        std::vector<std::string> vStrs = splitString(fields[1],",");
-        std::vector<double> vs;
-        for (size_t i = 0; i < vStrs.size(); i++)
+        nextField(idScoreStr, ':', strId);
+        std::vector<double> &vs = scores[toUInt64(strId)];
+        while (nextField(idScoreStr, ',', v))
         {
-            vs.push_back(atof(vStrs[i].c_str()));
+            vs.push_back(toDouble(v));
         }
-        scores[id] = vs;
     }
     return scores;
 }
 
 bool MetricModel::load(int y, std::map<uint64_t, std::vector<double>> *scores)
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
-
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + path));
-        return false;
-    }
-    char *errorMessage = NULL;
-
     // step 1: load scope metric
     std::string keywords = _scope.getKeywords();
     if (scores != NULL)
     {
-        CallbackData data;
-        std::stringstream ss;
-        ss << "SELECT keywords, year, scores FROM scope_metric WHERE keywords = '"
-            << keywords << "' AND year = " << y << ";";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK || data.results.size() == 0)
+        Statement stmt(_scope.preparePartition("SELECT scores FROM scope_metric WHERE keywords = ? AND year = ?;"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        if (!stmt.step())
         {
-            logDebug(errorMessage);
-            sqlite3_close(db);
+            if (!stmt.done())
+                logDebug(stmt.errorMessage());
             return false;
         }
-        *scores = getScores(data.results[0]["scores"]);
+        *scores = getScores(stmt.getText(0));
     }
     else
     {
-        CallbackData data;
-        std::stringstream ss;
-        ss << "SELECT keywords, year FROM scope_metric WHERE keywords = '"
-            << keywords << "' AND year = " << y << ";";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK || data.results.size() == 0)
+        Statement stmt(_scope.preparePartition("SELECT year FROM scope_metric WHERE keywords = ? AND year = ?;"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        if (!stmt.step())
         {
-            if (rc!=SQLITE_OK)
-                logDebug(errorMessage);
-            sqlite3_close(db);
+            if (!stmt.done())
+                logDebug(stmt.errorMessage());
             return false;
         }
     }
 
-    sqlite3_close(db);
     return true;
 }
 
 bool MetricModel::save(int y, const std::map<uint64_t, std::vector<double>> &scores)
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
-
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + path));
+    sqlite3 *db = _scope.partitionDb();
+    if (db == NULL)
         return false;
-    }
+    int rc = SQLITE_OK;
     char *errorMessage = NULL;
 
     // step 1: create tables
@@ -165,7 +143,6 @@ bool MetricModel::save(int y, const std::map<uint64_t, std::vector<double>> &sco
         if (rc != SQLITE_OK)
         {
             logError(errorMessage);
-            sqlite3_close(db);
             return false;
         }
     }
@@ -175,21 +152,20 @@ bool MetricModel::save(int y, const std::map<uint64_t, std::vector<double>> &sco
     time_t t;
     time(&t);
     {
-        std::stringstream ss;
-        ss << "INSERT OR IGNORE INTO scope_metric(keywords, year, scores, update_time) VALUES ('"
-            << keywords << "'," << y << ",'" << getScoreStr(scores) << "'," << (int)t << ");";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), NULL, NULL, &errorMessage);
-        if (rc != SQLITE_OK)
+        Statement stmt(_scope.preparePartition("INSERT OR IGNORE INTO scope_metric(keywords, year, scores, update_time) VALUES (?,?,?,?);"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        stmt.bind(3, getScoreStr(scores));
+        stmt.bind(4, (int)t);
+        if (!stmt.execute())
         {
-            logError(errorMessage);
-            sqlite3_close(db);
+            logError(stmt.errorMessage());
             return false;
         }
     }
 
-    sqlite3_close(db);
     return true;
 }
 
@@ -212,68 +188,37 @@ bool MetricModel::process(int y)
     std::map<uint64_t,int> oldCitations[10], newCitations[5];
     double sumOldPubs = 0;
     {
-        // step 3: load publications
-        std::map<uint64_t, std::vector<uint64_t>> oldPubs[10], newPubs[5];
+        // step 3: count publications
         for (int i = 0; i < 15; i++)
         {
             int yi = y - 1 - i;
             if (yi >= WESTSeerApp::year())
                 continue;
 
-            std::map<uint64_t, std::vector<uint64_t>> pubs;
-            if (!_scope.getExistingRefIds(yi, pubs))
+            if (!_scope.queried(yi))
                 return false;
-            if (i < 5)
+            if (i >= 5)
             {
-                newPubs[4 - i] = pubs;
-            }
-            else
-            {
-                oldPubs[9 - (i - 5)] = pubs;
+                sumOldPubs += _scope.numPublications(yi);
             }
         }
 
         // step 4: get citations per year of candidates
-        for (int i = 0; i <10; i++)
+        for (auto &idToP: prediction)
         {
-            sumOldPubs += oldPubs[i].size();
-            for (auto idToRefIds: oldPubs[i])
+            std::map<int, std::set<uint64_t>> citersOfYear;
+            if (!_scope.getCiters(idToP.first, y - 15, std::min(y, WESTSeerApp::year()), citersOfYear))
+                return false;
+            for (auto &yToCiters: citersOfYear)
             {
-                for (uint64_t refId: idToRefIds.second)
+                int i = y - 1 - yToCiters.first;
+                if (i < 5)
                 {
-                    if (prediction.find(refId) != prediction.end())
-                    {
-                        auto ridToC = oldCitations[i].find(refId);
-                        if (ridToC == oldCitations[i].end())
-                        {
-                            oldCitations[i][refId] = 1;
-                        }
-                        else
-                        {
-                            oldCitations[i][refId] = ridToC->second + 1;
-                        }
-                    }
+                    newCitations[4 - i][idToP.first] = yToCiters.second.size();
                 }
-            }
-        }
-        for (int i = 0; i <5; i++)
-        {
-            for (auto idToRefIds: newPubs[i])
-            {
-                for (uint64_t refId: idToRefIds.second)
+                else
                 {
-                    if (prediction.find(refId) != prediction.end())
-                    {
-                        auto ridToC = newCitations[i].find(refId);
-                        if (ridToC == newCitations[i].end())
-                        {
-                            newCitations[i][refId] = 1;
-                        }
-                        else
-                        {
-                            newCitations[i][refId] = ridToC->second + 1;
-                        }
-                    }
+                    oldCitations[9 - (i - 5)][idToP.first] = yToCiters.second.size();
                 }
             }
         }
@@ -281,12 +226,13 @@ bool MetricModel::process(int y)
 
     // step 5: compute prediction and verification scores for each candidate
     std::map<uint64_t, std::vector<double>> scores;
-    for (auto idToP: prediction)
+    for (auto &idToP: prediction)
     {
         uint64_t id = idToP.first;
-        Eigen::MatrixXd plm = timeSeries[idToP.first].first.first;
-        Eigen::MatrixXd slm = timeSeries[idToP.first].second.first;
-        Eigen::MatrixXd prm = idToP.second.first;
+        const TimeSeriesMatrices &tsm = timeSeries[id];
+        const Eigen::MatrixXd &plm = tsm.first.first;
+        const Eigen::MatrixXd &slm = tsm.second.first;
+        const Eigen::MatrixXd &prm = idToP.second.first;
         int realOldCitations[10], oldTopicHits[10], oldPubHits[10], realNewCitations[5];
         double predNewCitations[5];
         double sumOld = 0, sumP = 0;
@@ -376,5 +322,12 @@ bool MetricModel::process(int y)
         }
         scores[id] = myScores;
     }
-    return save(y, scores);
+    // save scores while the next year is evaluated
+    auto results = std::make_shared<std::map<uint64_t, std::vector<double>>>();
+    results->swap(scores);
+    _scope.saveLater([this, y, results]()
+        {
+            return save(y, *results);
+        });
+    return true;
 }
@@ -7,8 +7,11 @@
 #include <regex>
 #include <fstream>
 #include <algorithm>
-#define CPPHTTPLIB_OPENSSL_SUPPORT
-#include <httplib.h>
+#include <thread>
+#include <atomic>
+#include <BoundedQueue.h>
+#include <WorksParser.h>
+#include <ReferenceFetcher.h>
 
 void OpenAlex::init()
 {
@@ -27,7 +30,8 @@ void OpenAlex::init()
             std::vector<std::string> kws = splitString(combination, "&");
             std::stringstream ss;
             ss << "/works?mailto=" << _email
-               << "&per-page=200&filter=publication_year:"
+               << "&per-page=200&select=" << WorksParser::FIELDS
+               << "&filter=publication_year:"
                << y << ",language:en";
             ss << ",abstract.search:\""
                << kws[0] << "\"";
@@ -41,6 +45,8 @@ void OpenAlex::init()
     _samples.resize(numCombs);
     _scope.init();
     _samplesOnly = false;
+    _upgradeFailed = false;
+    _client = OpenAlexClient::open(config.getServer(), config.getRequestsPerSecond(), config.getConnections());
 }
 
 OpenAlex::OpenAlex(const std::string email, const std::string path,
@@ -58,10 +64,14 @@ OpenAlex::OpenAlex(const std::string email, const std::string path, const std::s
 
 OpenAlex::~OpenAlex()
 {
+    flush();
 }
 
 bool OpenAlex::finished()
 {
+    // the first step builds the tables a database crawled by an older version lacks
+    if (!_samplesOnly && !_scope.upgraded())
+        return false;
     int numCombs = _scope.numCombinations();
     for (int y = _y2 - 1; y >= _y0; y--)
     {
@@ -101,26 +111,103 @@ int getResultCount(const nlohmann::json& response)
     return meta["count"];
 }
 
-std::string getNextCursor(const nlohmann::json& response)
+static const size_t MAX_QUEUED_PAGES = 4;
+static const size_t MAX_QUEUED_BATCHES = 2;
+static const size_t BATCH_SIZE = 2000;
+static const int NUM_PARSERS = 2;
+
+// a page of works, numbered in crawl order, with the cursor of the page after it
+struct WorksPage
 {
-    if (response.find("meta") == response.end())
-    {
+    int seq;
+    std::string body;
+    std::string nextCursor;
+};
+
+// the works parsed from some pages, with the cursors of the pages after them by number
+struct WorksBatch
+{
+    std::map<uint64_t, Publication> pubs;
+    std::map<int, std::string> nextCursors;
+};
+
+// find the next cursor in the meta object heading a page, so that it can be requested before the page is parsed
+static std::string findNextCursor(const std::string &body)
+{
+    size_t end = body.find("\"results\"");
+    size_t pos = body.find("\"next_cursor\"");
+    if (pos == std::string::npos || pos > end)
+        return "";
+    pos = body.find_first_not_of(" \t\r\n:", pos + 13);
+    if (pos == std::string::npos || body[pos] != '"')
         return "";
+    end = body.find('"', pos + 1);
+    if (end == std::string::npos)
+        return "";
+    return body.substr(pos + 1, end - pos - 1);
+}
+
+// add the works on a page to pubs, and to samples if given, getting the cursor of the next page if asked
+bool OpenAlex::parsePage(const std::string &body, std::map<uint64_t, Publication> &pubs, std::vector<Publication> *samples, std::string *nextCursor)
+{
+    WorksParser parser(pubs, samples);
+    if (!nlohmann::json::sax_parse(body, &parser))
+    {
+        logError("Invalid page from OpenAlex");
+        return false;
     }
-    auto meta = response["meta"];
-    if (meta.find("next_cursor") == meta.end())
+    if (nextCursor != NULL)
+        *nextCursor = parser.nextCursor();
+    return true;
+}
+
+// crawl the combination-year of this step, having started those of the next steps, one per connection
+void OpenAlex::doStep(int stepId)
+{
+    // the crawls save citations, so the run stops unless the tables are upgraded first
+    if (stepId == 0 && !_samplesOnly && !_scope.upgrade())
     {
-        return "";
+        logError("Cannot upgrade the database %s", _scope.database()->path().c_str());
+        _upgradeFailed = true;
+        _cancelled.store(true);
+        return;
     }
-    auto nextCursor = meta["next_cursor"];
-    if (nextCursor.is_null() || nextCursor == "")
+    if (!_samplesOnly && !_refs)
+        _refs.reset(new ReferenceFetcher(_scope, _client, _email, _cancelled));
+    int numCrawls = std::min(numSteps(), stepId + _client->numConnections());
+    for (int nextStepId = stepId; nextStepId < numCrawls; nextStepId++)
     {
-        return "";
+        if (_crawls.find(nextStepId) == _crawls.end())
+        {
+            _crawls[nextStepId] = std::async(std::launch::async, [this, nextStepId]()
+                {
+                    crawl(nextStepId);
+                });
+        }
     }
-    return nextCursor;
+    auto stepToCrawl = _crawls.find(stepId);
+    stepToCrawl->second.wait();
+    _crawls.erase(stepToCrawl);
 }
 
-void OpenAlex::doStep(int stepId)
+// wait for the crawls started ahead, which return early once cancelled, and for the references they queued
+bool OpenAlex::flush()
+{
+    for (auto &stepToCrawl: _crawls)
+    {
+        stepToCrawl.second.wait();
+    }
+    _crawls.clear();
+    bool ret = !_upgradeFailed;
+    _upgradeFailed = false;
+    if (!_refs)
+        return ret;
+    ret = _refs->finish() && ret;
+    _refs.reset();
+    return ret;
+}
+
+void OpenAlex::crawl(int stepId)
 {
     int numCombs = _scope.numCombinations();
     int i = stepId / numCombs;
@@ -131,138 +218,143 @@ void OpenAlex::doStep(int stepId)
 
     std::vector<std::string> urlsOfY = _urls[i].second;
     std::string url = urlsOfY[j];
-    std::map<uint64_t, Publication> pubsOfY;
     logDebug(url.c_str());
-
-    // get first page of this download url
-    httplib::Client client("https://api.openalex.org");
-    auto res = client.Get(url + "&cursor=*");
-    while (res->status != 200)
+    if (_samplesOnly)
     {
-        if (_cancelled.load() == true)
+        std::string body;
+        if (!_client->get(url + "&cursor=*", body, _cancelled))
             return;
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            res = client.Get(url + "&cursor=*");
-    }
-    if (_cancelled.load() == true)
+        std::map<uint64_t, Publication> pubsOfPage;
+        _samples[j].clear();
+        parsePage(body, pubsOfPage, &_samples[j]);
         return;
-
-    // parse the response on the first page
-    logDebug("parse the response on the first page");
-    nlohmann::json response = nlohmann::json::parse(res->body);
-    std::string nextCursor = getNextCursor(response);
-    auto resultsOnPage = response["results"];
-    int numResultsOnPage = resultsOnPage.size();
-    _samples[j].clear();
-    if (numResultsOnPage > 0)
-    {
-        for (auto &result: resultsOnPage)
-        {
-            Publication pub(result);
-            pubsOfY[pub.id()] = pub;
-            _samples[j].push_back(pub);
-        }
     }
 
-    if (_samplesOnly)
+    // the works of a year saved before the crawl was interrupted are not fetched again,
+    // and its missing references are queued, the token being written once they are saved
+    if (!_scope.queried(j, y) && !crawlWorks(j, y, url))
         return;
+    _refs->add(j, y);
+}
 
-    // repeatedly get next page
-    while (nextCursor != "")
-    {
-        // request next page
-        logDebug("request next page");
-        std::string pageURL = url + "&cursor=" + nextCursor;
-        res = client.Get(pageURL);
-        while (res->status != 200)
-        {
-            if (_cancelled.load() == true)
-                return;
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-            res = client.Get(pageURL);
-        }
-        if (_cancelled.load() == true)
-            return;
+// fetch, parse and save all pages of works of a combination-year, marking them saved once all are.
+// Saving a batch also checkpoints the cursor after the last page whose works are all saved, so an
+// interrupted crawl continues from there instead of from the first page.
+bool OpenAlex::crawlWorks(int j, const int y, const std::string &url)
+{
+    std::string startCursor = "*";
+    int numWorks = 0;
+    if (_scope.getCursor(j, y, startCursor, numWorks))
+        logMessage("Resume %s in %d after %d works", _scope.getCombination(j).c_str(), y, numWorks);
+    else
+        startCursor = "*";
 
-        // parse the page
-        logDebug("parse the page");
-        response = nlohmann::json::parse(res->body);
-        nextCursor = getNextCursor(response);
-        resultsOnPage = response["results"];
-        for (auto &result: resultsOnPage)
+    // ---------------------------------------------------------------------------
+    // step 1: fetch the cursor pages on a thread of their own, the next page being requested while the last is parsed
+    BoundedQueue<WorksPage> pages(MAX_QUEUED_PAGES);
+    BoundedQueue<WorksBatch> batches(MAX_QUEUED_BATCHES);
+    std::atomic<bool> complete(false);
+    std::atomic<bool> failed(false);
+    std::thread fetcher([&]()
         {
-            Publication pub(result);
-            pubsOfY[pub.id()] = pub;
-        }
-        std::this_thread::sleep_for(std::chrono::milliseconds(100));
-    }
-
-    logDebug("save");
-    _scope.save(j, y, pubsOfY);
+            std::string cursor = startCursor;
+            for (int seq = 0; !cursor.empty(); seq++)
+            {
+                logDebug("request next page");
+                WorksPage page;
+                page.seq = seq;
+                if (!_client->get(url + "&cursor=" + cursor, page.body, _cancelled))
+                    break;
+                cursor = findNextCursor(page.body);
+                page.nextCursor = cursor;
+                if (!pages.push(std::move(page)))
+                    break;
+                if (cursor.empty())
+                    complete.store(true);
+            }
+            pages.close();
+        });
 
-    if (_cancelled.load() == true)
+    // ---------------------------------------------------------------------------
+    // step 2: parse the pages into batches of publications
+    std::vector<std::thread *> parsers;
+    for (int tid = 0; tid < NUM_PARSERS; tid++)
     {
-        return;
+        parsers.push_back(new std::thread([&]()
+            {
+                WorksBatch batch;
+                WorksPage page;
+                while (pages.pop(page))
+                {
+                    logDebug("parse the page");
+                    // the cursor found by scanning the page has to be the one in its meta object,
+                    // or the crawl would stop early and take the year for complete
+                    std::string nextCursor;
+                    bool parsed = parsePage(page.body, batch.pubs, NULL, &nextCursor);
+                    if (parsed && nextCursor != page.nextCursor)
+                    {
+                        logError("The next cursor scanned from page %d differs from its meta object", page.seq);
+                        parsed = false;
+                    }
+                    if (!parsed)
+                    {
+                        failed.store(true);
+                        pages.close();
+                        continue;
+                    }
+                    batch.nextCursors[page.seq] = page.nextCursor;
+                    if (batch.pubs.size() >= BATCH_SIZE)
+                    {
+                        batches.push(std::move(batch));
+                        batch = WorksBatch();
+                    }
+                }
+                if (!batch.nextCursors.empty())
+                    batches.push(std::move(batch));
+            }));
     }
 
-     // get references
-     logDebug("get references");
-     std::map<uint64_t, Publication> refsOfY;
-     std::vector<uint64_t> newRefIds;
-     if (_scope.getMissingRefIds(j, y, newRefIds))
-     {
-        // get new references
-		for (size_t idxRef0 = 0; idxRef0 < newRefIds.size(); idxRef0 += 50)
+    // ---------------------------------------------------------------------------
+    // step 3: save every batch as soon as it is parsed, stopping the fetcher on failure; the pages
+    // are parsed out of order, so the checkpoint only moves past pages that are all saved
+    std::thread writer([&]()
         {
-			size_t idxRef1 = idxRef0 + 50;
-			if (idxRef1 > newRefIds.size())
-			{
-				idxRef1 = newRefIds.size();
-			}
-
-			// create url
-			std::stringstream ssURL;
-			ssURL << "/works?mailto=" << _email
-				<< "&per-page=200&filter=language:en,ids.openalex:"
-				<< Publication::convertId(newRefIds[idxRef0], 'W');
-			for (size_t idxRef = idxRef0 + 1; idxRef < idxRef1; idxRef++)
+            std::map<int, std::string> savedCursors;
+            int nextSeq = 0;
+            WorksBatch batch;
+            while (batches.pop(batch))
             {
-				ssURL << "|" << Publication::convertId(newRefIds[idxRef], 'W');
-			}
-			std::string url = ssURL.str();
-
-			// make request
-			res = client.Get(url);
-			while (res->status != 200)
-			{
-				if (_cancelled.load() == true)
+                logDebug("save");
+                savedCursors.insert(batch.nextCursors.begin(), batch.nextCursors.end());
+                std::string checkpoint;
+                for (auto seqToCursor = savedCursors.find(nextSeq); seqToCursor != savedCursors.end(); seqToCursor = savedCursors.find(nextSeq))
                 {
-					return;
-				}
-				std::this_thread::sleep_for(std::chrono::milliseconds(100));
-				res = client.Get(url);
-			}
-			if (_cancelled.load() == true)
-            {
-				return;
-			}
+                    checkpoint = seqToCursor->second;
+                    savedCursors.erase(seqToCursor);
+                    nextSeq++;
+                }
+                if (!failed.load() && !_scope.save(j, y, batch.pubs, false, checkpoint))
+                {
+                    failed.store(true);
+                    pages.close();
+                }
+            }
+        });
 
-			// parse response
-			response = nlohmann::json::parse(res->body);
-			auto resultsOfResponse = response["results"];
-			for (auto result: resultsOfResponse) {
-                Publication refPub(result);
-				refsOfY[refPub.id()] = refPub;
-			}
+    fetcher.join();
+    for (std::thread *parser: parsers)
+    {
+        parser->join();
+        delete parser;
+    }
+    batches.close();
+    writer.join();
 
-			if (_cancelled.load() == true)
-            {
-				return;
-			}
-		}
-		_scope.save(refsOfY);
-     }
-     _scope.save(j, y);
+    // ---------------------------------------------------------------------------
+    // step 4: mark the works of the year saved once all pages are
+    if (!complete.load() || failed.load() || _cancelled.load() == true)
+        return false;
+    return _scope.save(j, y, std::map<uint64_t, Publication>(), true);
 }
 
 
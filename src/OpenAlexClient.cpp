@@ -0,0 +1,103 @@
+#include "OpenAlexClient.h"
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <wxFFileLog.h>
+#define CPPHTTPLIB_OPENSSL_SUPPORT
+#include <httplib.h>
+
+std::mutex OpenAlexClient::_registryMutex;
+std::map<std::string, std::weak_ptr<OpenAlexClient>> OpenAlexClient::_registry;
+
+OpenAlexClient::OpenAlexClient(const std::string server, int requestsPerSecond, int numConnections)
+    : _limiter(requestsPerSecond, requestsPerSecond)
+{
+    //ctor
+    _server = server;
+    _numConnections = std::max(numConnections, 1);
+}
+
+OpenAlexClient::~OpenAlexClient()
+{
+    //dtor
+    for (httplib::Client *client: _clients)
+    {
+        delete client;
+    }
+}
+
+// take an idle connection, opening one if the pool is not full yet
+httplib::Client *OpenAlexClient::borrow()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_idle.empty() && (int)_clients.size() < _numConnections)
+    {
+        httplib::Client *client = new httplib::Client(_server);
+        client->set_keep_alive(true);
+        client->set_connection_timeout(10);
+        client->set_read_timeout(60);
+        _clients.push_back(client);
+        return client;
+    }
+    _givenBack.wait(lock, [this]()
+        {
+            return !_idle.empty();
+        });
+    httplib::Client *client = _idle.back();
+    _idle.pop_back();
+    return client;
+}
+
+void OpenAlexClient::giveBack(httplib::Client *client)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _idle.push_back(client);
+    }
+    _givenBack.notify_one();
+}
+
+// get the body of a successful response to the path, returning false only if cancelled before
+bool OpenAlexClient::get(const std::string &path, std::string &body, const std::atomic<bool> &cancelled)
+{
+    httplib::Client *client = borrow();
+    bool result = false;
+    int numFailures = 0;
+    while (cancelled.load() == false)
+    {
+        _limiter.acquire();
+        auto res = client->Get(path);
+        if (res && res->status == 200)
+        {
+            body.swap(res->body);
+            result = true;
+            break;
+        }
+        if (res)
+            logDebug("HTTP %d: %s", res->status, path.c_str());
+        else
+            logDebug("%s: %s", httplib::to_string(res.error()).c_str(), path.c_str());
+        if (res && res->status == 429)
+            _limiter.backOff(1.0);
+        else
+            std::this_thread::sleep_for(std::chrono::milliseconds(100 << std::min(numFailures, 6)));
+        numFailures++;
+    }
+    giveBack(client);
+    return result;
+}
+
+std::shared_ptr<OpenAlexClient> OpenAlexClient::open(const std::string server, int requestsPerSecond, int numConnections)
+{
+    std::lock_guard<std::mutex> lock(_registryMutex);
+    auto serverToClient = _registry.find(server);
+    if (serverToClient != _registry.end())
+    {
+        std::shared_ptr<OpenAlexClient> client = serverToClient->second.lock();
+        if (client)
+            return client;
+    }
+    std::shared_ptr<OpenAlexClient> client(new OpenAlexClient(server, requestsPerSecond, numConnections));
+    _registry[server] = client;
+    return client;
+}
@@ -2,7 +2,8 @@
 #include <../WESTSeerApp.h>
 #include <GeneralConfig.h>
 #include <StringProcessing.h>
-#include <CallbackData.h>
+#include <Transaction.h>
+#include <fstream>
 
 PredictionModel::PredictionModel(const std::string path, const std::string kws, const std::string modelFileName, TimeSeriesExtraction *tse):_scope(path, kws),_model(modelFileName.c_str())
 {
@@ -13,6 +14,10 @@ PredictionModel::PredictionModel(const std::string path, const std::string kws,
     _y0 = _y2 - config.getObYears();
     _tse = tse;
     _name = "Prediction Training";
+
+    // after a year rollover, continue training the model checkpointed last year
+    std::ifstream lastCheckpoint((getCheckpointPath(_y2 - 1) + ".index").c_str());
+    _warmStart = lastCheckpoint.good();
 }
 
 PredictionModel::~PredictionModel()
@@ -40,9 +45,18 @@ const char *PredictionModel::name()
     return _name.c_str();
 }
 
+// get the prefix of the checkpoint files of the model trained in year y, which depends on the number of biterms per topic
+std::string PredictionModel::getCheckpointPath(int y)
+{
+    GeneralConfig config;
+    std::stringstream ss;
+    ss << "lstm_" << config.getBiterms();
+    return _scope.getSnapshotPath(ss.str(), y);
+}
+
 int PredictionModel::numSteps()
 {
-    return 100;
+    return _warmStart ? 10 : 100;
 }
 
 void PredictionModel::doStep(int stepId)
@@ -52,80 +66,52 @@ void PredictionModel::doStep(int stepId)
 
 bool PredictionModel::load(int y, std::map<uint64_t, std::pair<Eigen::MatrixXd,Eigen::MatrixXd>> *prediction)
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
-
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + path));
-        return false;
-    }
-    char *errorMessage = NULL;
-
     // step 1: load time series
     std::string keywords = _scope.getKeywords();
     if (prediction != NULL)
     {
-        CallbackData data;
-        std::stringstream ss;
-        ss << "SELECT id, scope_keywords, year, prm, srm FROM pub_scope_prediction WHERE scope_keywords = '"
-            << keywords << "' AND year = " << y << ";";
-        std::string strSql = ss.str();
-        rc = sqlite3_exec(db, strSql.c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logDebug(errorMessage);
-            sqlite3_close(db);
+        Statement stmt(_scope.preparePartition("SELECT id, prm, srm FROM pub_scope_prediction WHERE scope_keywords = ? AND year = ?;"));
+        if (!stmt.ok())
             return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        while (stmt.step())
+        {
+            uint64_t id = stmt.getUInt64(0);
+            std::pair<Eigen::MatrixXd,Eigen::MatrixXd> &tsm = (*prediction)[id];
+            tsm.first = getMatrix(stmt, 1);
+            tsm.second = getMatrix(stmt, 2);
         }
-        for (auto result: data.results)
+        if (!stmt.done())
         {
-            uint64_t id = std::stoull(result["id"]);
-            Eigen::MatrixXd prm = deserializeMatrix(result["prm"]);
-            Eigen::MatrixXd srm = deserializeMatrix(result["srm"]);
-            std::pair<Eigen::MatrixXd,Eigen::MatrixXd> tsm(prm,srm);
-            (*prediction)[id] = tsm;
+            logDebug(stmt.errorMessage());
+            return false;
         }
     }
 
     // step 2: load token
     {
-        CallbackData data;
-        std::stringstream ss;
-        ss << "SELECT keywords, year FROM scope_prediction_token WHERE keywords = '"
-            << keywords << "' AND year = " << _y2 << ";";
-        std::string strSql = ss.str();
-        rc = sqlite3_exec(db, strSql.c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logDebug(errorMessage);
-            sqlite3_close(db);
+        Statement stmt(_scope.preparePartition("SELECT year FROM scope_prediction_token WHERE keywords = ? AND year = ?;"));
+        if (!stmt.ok())
             return false;
-        }
-        if (data.results.size() == 0)
+        stmt.bind(1, keywords);
+        stmt.bind(2, _y2);
+        if (!stmt.step())
         {
-            sqlite3_close(db);
+            if (!stmt.done())
+                logDebug(stmt.errorMessage());
             return false;
         }
     }
-    sqlite3_close(db);
     return true;
 }
 
 bool PredictionModel::save(int y, std::map<uint64_t, std::pair<Eigen::MatrixXd,Eigen::MatrixXd>> &prediction)
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
-
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + path));
+    sqlite3 *db = _scope.partitionDb();
+    if (db == NULL)
         return false;
-    }
+    int rc = SQLITE_OK;
     char *errorMessage = NULL;
 
     // step 1: create tables
@@ -153,78 +139,67 @@ bool PredictionModel::save(int y, std::map<uint64_t, std::pair<Eigen::MatrixXd,E
         if (rc != SQLITE_OK)
         {
             logError(errorMessage);
-            sqlite3_close(db);
             return false;
         }
     }
 
     // step 2: insert publication scope time series
+    Transaction tx(db);
+    if (!tx.ok())
+        return false;
     std::string keywords = _scope.getKeywords();
     {
-        std::stringstream ss;
-        ss << "INSERT OR IGNORE INTO pub_scope_prediction(id, scope_keywords, year, prm, srm) VALUES ";
+        Statement stmt(_scope.preparePartition("INSERT OR IGNORE INTO pub_scope_prediction(id, scope_keywords, year, prm, srm) VALUES (?,?,?,?,?);"));
+        if (!stmt.ok())
+            return false;
         for (auto idToTS = prediction.begin(); idToTS != prediction.end(); idToTS++)
         {
             uint64_t id = idToTS->first;
-            Eigen::MatrixXd prm = idToTS->second.first;
-            Eigen::MatrixXd srm = idToTS->second.second;
-            std::string strPrm = serializeMatrix(prm);
-            std::string strSrm = serializeMatrix(srm);
-            if (idToTS != prediction.begin())
-                ss << ",";
-            ss << "(" << id << ",'" << keywords << "'," << y << ",'"
-                << strPrm << "','" << strSrm << "')";
-        }
-        ss << ";";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), NULL, NULL, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logError(errorMessage);
-            sqlite3_close(db);
-            return false;
+            const Eigen::MatrixXd &prm = idToTS->second.first;
+            const Eigen::MatrixXd &srm = idToTS->second.second;
+            stmt.bind(1, id);
+            stmt.bind(2, keywords);
+            stmt.bind(3, y);
+            stmt.bindBlob(4, serializeMatrix(prm));
+            stmt.bindBlob(5, serializeMatrix(srm));
+            if (!stmt.execute())
+            {
+                logError(stmt.errorMessage());
+                return false;
+            }
+            if (!tx.step())
+                return false;
         }
     }
 
-    sqlite3_close(db);
-    return true;
+    return tx.commit();
 }
 
 bool PredictionModel::save(int y, std::vector<double> &loss)
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
-
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + path));
+    sqlite3 *db = _scope.partitionDb();
+    if (db == NULL)
         return false;
-    }
-    char *errorMessage = NULL;
 
     // insert token
     std::string keywords = _scope.getKeywords();
     time_t t;
     time(&t);
     {
-        std::stringstream ss;
-        ss << "INSERT OR IGNORE INTO scope_prediction_token(keywords,year,loss,update_time) VALUES ('"
-            << keywords << "'," << y << ",'" << getVectorStr(loss) << "'," << (int) t << ");";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), NULL, NULL, &errorMessage);
-        if (rc != SQLITE_OK)
+        Statement stmt(_scope.preparePartition("INSERT OR IGNORE INTO scope_prediction_token(keywords,year,loss,update_time) VALUES (?,?,?,?);"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        stmt.bind(3, getVectorStr(loss));
+        stmt.bind(4, (int)t);
+        if (!stmt.execute())
         {
-            logError(errorMessage);
-            sqlite3_close(db);
+            logError(stmt.errorMessage());
             return false;
         }
     }
 
-    sqlite3_close(db);
     return true;
 }
 
@@ -297,6 +272,11 @@ bool PredictionModel::process(int iStep)
             }
         }
         _model.init();
+        if (_warmStart && !_model.checkpoint(getCheckpointPath(_y2 - 1).c_str(), false))
+        {
+            logError("Cannot restore last year's prediction model, training it from scratch.");
+            _model.init();
+        }
         _loss.push_back(_model.loss(_input, _target));
     }
 
@@ -309,8 +289,11 @@ bool PredictionModel::process(int iStep)
     _loss.push_back(_model.loss(_input, _target));
 
     // step 3: predict
-    if (iStep == 99)
+    if (iStep == numSteps() - 1)
     {
+        Transaction tx(_scope.partitionDb());
+        if (!tx.ok())
+            return false;
         int ys[2] = {_y2, _y2 + 5};
         for (int y: ys)
         {
@@ -333,10 +316,15 @@ bool PredictionModel::process(int iStep)
                 prediction[id] = splitRows(predOutput[i]);
             }
 
-            save(y, prediction);
+            if (!save(y, prediction))
+                return false;
         }
 
-        save(_y2, _loss);
+        if (!save(_y2, _loss) || !tx.commit())
+            return false;
+
+        // step 4: keep the model for next year's warm start
+        _model.checkpoint(getCheckpointPath(_y2).c_str(), true);
     }
 
 
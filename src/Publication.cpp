@@ -2,6 +2,7 @@
 #include "StringProcessing.h"
 #include <sstream>
 #include <map>
+#include <algorithm>
 #include <cassert>
 
 uint64_t Publication::convertId(const std::string idString, const char chType)
@@ -41,6 +42,22 @@ string Publication::convertId(const uint64_t id, const char chType)
     return ss.str();
 }
 
+// turn a name written as "last, first" into "first last"
+string Publication::convertAuthorName(const string& displayName)
+{
+    if (displayName.find(",") == string::npos)
+        return displayName;
+    vector<string> fields = splitString(displayName, ",");
+    string authorName = "";
+    for (int i = fields.size() - 1; i >= 0; i--)
+    {
+        if (authorName.size() > 0)
+            authorName += " ";
+        authorName += fields[i];
+    }
+    return authorName;
+}
+
 Publication::Publication()
 {
     _id = 0;
@@ -62,6 +79,11 @@ Publication::Publication(const map<string,string>& work)
     init(work);
 }
 
+Publication::Publication(const Statement& row)
+{
+    init(row);
+}
+
 Publication::Publication(const Publication& another)
 {
     _id = another._id;
@@ -213,18 +235,7 @@ void Publication::init(const json& jsonWork)
                 if (dn != author.end() && dn.value().type() != json::value_t::null)
                 {
                     string authorName = dn.value();
-                    if (authorName.find(",") != string::npos)
-                    {
-                        vector<string> fields = splitString(authorName, ",");
-                        authorName = "";
-                        for (int i = fields.size() - 1; i >= 0; i--)
-                        {
-                            if (authorName.size() > 0)
-                                authorName += " ";
-                            authorName += fields[i];
-                        }
-                    }
-                    _authors.push_back(wxStr(authorName));
+                    _authors.push_back(wxStr(convertAuthorName(authorName)));
                 }
             }
         }
@@ -299,6 +310,52 @@ void Publication::init(const map<string,string>& work)
     }
 }
 
+// same replacements as allocateWStr, but reading straight from a database column
+static wxString columnWStr(meta::util::string_view text)
+{
+    std::wstring s(text.begin(), text.end());
+    std::replace(s.begin(), s.end(), L'\'', L'`');
+    std::replace(s.begin(), s.end(), L'\n', L' ');
+    return wxString(s);
+}
+
+// read the current row, whose columns are id, year, title, abstract, source, language, authors, ref_ids
+void Publication::init(const Statement& row)
+{
+    _id = row.getUInt64(0);
+    _year = row.getInt(1);
+    _title = columnWStr(row.getText(2));
+    _abstract = columnWStr(row.getText(3));
+    _source = columnWStr(row.getText(4));
+    _language = columnWStr(row.getText(5));
+
+    // authors are trimmed and converted with the locale like wxStr, not widened byte by byte like the other columns
+    meta::util::string_view text = row.getText(6);
+    _authors = splitWString(std::string(text.begin(), text.end()), ",");
+
+    meta::util::string_view field;
+    text = row.getText(7);
+    _refIds.clear();
+    while (nextField(text, ',', field))
+    {
+        _refIds.push_back(toUInt64(field));
+    }
+}
+
+// the select list of a publications row with the given fields, the table optionally qualified by alias
+string Publication::columns(int fields, const string& alias)
+{
+    static const char *names[] = {"title", "abstract", "source", "language", "authors", "ref_ids"};
+    string prefix = alias.empty() ? "" : alias + ".";
+    string result = prefix + "id, " + prefix + "year";
+    for (int i = 0; i < 6; i++)
+    {
+        result += ", ";
+        result += (fields & (1 << i)) ? prefix + names[i] : "''";
+    }
+    return result;
+}
+
 void Publication::parse(const string& strJson)
 {
     auto jsonWork = json::parse(strJson);
@@ -0,0 +1,49 @@
+#include "RateLimiter.h"
+#include <thread>
+#include <algorithm>
+
+RateLimiter::RateLimiter(double rate, double burst)
+{
+    //ctor
+    _rate = std::max(rate, 0.1);
+    _burst = std::max(burst, 1.0);
+    _tokens = _burst;
+    _lastRefill = std::chrono::steady_clock::now();
+}
+
+RateLimiter::~RateLimiter()
+{
+    //dtor
+}
+
+// add the tokens accrued since the last refill
+void RateLimiter::refill()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = now - _lastRefill;
+    _tokens = std::min(_burst, _tokens + elapsed.count() * _rate);
+    _lastRefill = now;
+}
+
+// take a token, waiting until one is due
+void RateLimiter::acquire()
+{
+    double wait = 0.0;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        refill();
+        _tokens -= 1.0;
+        if (_tokens < 0.0)
+            wait = -_tokens / _rate;
+    }
+    if (wait > 0.0)
+        std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+}
+
+// hold back every request for the given time, e.g. after the server said there were too many
+void RateLimiter::backOff(double seconds)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    refill();
+    _tokens = std::min(_tokens, 0.0) - seconds * _rate;
+}
@@ -0,0 +1,98 @@
+#include "ReferenceCache.h"
+
+std::mutex ReferenceCache::_registryMutex;
+std::map<std::pair<std::string, std::string>, std::weak_ptr<ReferenceCache>> ReferenceCache::_registry;
+
+ReferenceCache::ReferenceCache(size_t capacity)
+{
+    //ctor
+    _capacity = capacity;
+    _size = 0;
+    _generation = 0;
+}
+
+ReferenceCache::~ReferenceCache()
+{
+    //dtor
+}
+
+// get the cached map of year y, or NULL together with the generation to hand back to put()
+std::shared_ptr<const RefIdsOfId> ReferenceCache::get(const int y, uint64_t &generation)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    generation = _generation;
+    auto yToEntry = _entries.find(y);
+    if (yToEntry == _entries.end())
+        return std::shared_ptr<const RefIdsOfId>();
+    _lru.splice(_lru.begin(), _lru, yToEntry->second.lru);
+    return yToEntry->second.refIdsOfId;
+}
+
+// cache the map of year y unless something was invalidated since it was read from the database
+void ReferenceCache::put(const int y, std::shared_ptr<const RefIdsOfId> refIdsOfId, uint64_t generation)
+{
+    size_t size = refIdsOfId->size();
+    for (auto &idToRefIds: *refIdsOfId)
+    {
+        size += idToRefIds.second.size();
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (generation != _generation || size > _capacity)
+        return;
+    auto yToEntry = _entries.find(y);
+    if (yToEntry != _entries.end())
+        erase(yToEntry);
+    while (_size + size > _capacity)
+    {
+        erase(_entries.find(_lru.back()));
+    }
+    _lru.push_front(y);
+    Entry &entry = _entries[y];
+    entry.refIdsOfId = refIdsOfId;
+    entry.size = size;
+    entry.lru = _lru.begin();
+    _size += size;
+}
+
+void ReferenceCache::erase(std::map<int, Entry>::iterator yToEntry)
+{
+    _size -= yToEntry->second.size;
+    _lru.erase(yToEntry->second.lru);
+    _entries.erase(yToEntry);
+}
+
+void ReferenceCache::invalidate(const int y)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _generation++;
+    auto yToEntry = _entries.find(y);
+    if (yToEntry != _entries.end())
+        erase(yToEntry);
+}
+
+void ReferenceCache::clear()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _generation++;
+    _entries.clear();
+    _lru.clear();
+    _size = 0;
+}
+
+// get the cache shared by all users of the same database and keywords, creating it if nobody holds it
+std::shared_ptr<ReferenceCache> ReferenceCache::open(const std::string path, const std::string keywords)
+{
+    std::lock_guard<std::mutex> lock(_registryMutex);
+    std::pair<std::string, std::string> key(path, keywords);
+    auto keyToCache = _registry.find(key);
+    if (keyToCache != _registry.end())
+    {
+        std::shared_ptr<ReferenceCache> cache = keyToCache->second.lock();
+        if (cache)
+            return cache;
+    }
+    std::shared_ptr<ReferenceCache> cache = std::make_shared<ReferenceCache>();
+    _registry[key] = cache;
+    return cache;
+}
@@ -0,0 +1,186 @@
+#include "ReferenceFetcher.h"
+#include <sstream>
+#include <WorksParser.h>
+#include <wxFFileLog.h>
+
+// the most ids the API takes in one filter, and the number of fetched references saved together
+static const size_t MAX_IDS_PER_REQUEST = 100;
+static const size_t BATCH_SIZE = 2000;
+
+ReferenceFetcher::ReferenceFetcher(ResearchScope &scope, std::shared_ptr<OpenAlexClient> client, const std::string email, const std::atomic<bool> &cancelled)
+    : _scope(scope), _cancelled(cancelled), _fetched(4)
+{
+    //ctor
+    _client = client;
+    _email = email;
+    _finishing = false;
+    _failed = false;
+    for (int tid = 0; tid < _client->numConnections(); tid++)
+    {
+        _workers.push_back(new std::thread(&ReferenceFetcher::fetch, this));
+    }
+    _writer = new std::thread(&ReferenceFetcher::write, this);
+}
+
+ReferenceFetcher::~ReferenceFetcher()
+{
+    //dtor
+    finish();
+}
+
+// queue the missing references of a combination-year whose works are saved, writing its token once they are
+bool ReferenceFetcher::add(int idxComb, const int y)
+{
+    std::vector<uint64_t> missingRefIds;
+    if (!_scope.getMissingRefIds(idxComb, y, missingRefIds))
+        return false;
+    Waiting waiting;
+    waiting.idxComb = idxComb;
+    waiting.y = y;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (uint64_t refId: missingRefIds)
+        {
+            if (_saved.find(refId) != _saved.end())
+                continue;
+            waiting.refIds.insert(refId);
+            if (_requested.insert(refId).second)
+                _pending.push_back(refId);
+        }
+        if (!waiting.refIds.empty())
+            _waiting.push_back(waiting);
+    }
+    _queued.notify_all();
+    if (waiting.refIds.empty())
+        return _scope.save(idxComb, y);
+    return true;
+}
+
+// fetch what is queued, then stop the workers and the writer, returning false if any references failed
+bool ReferenceFetcher::finish()
+{
+    if (_writer == NULL)
+        return !_failed;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _finishing = true;
+    }
+    _queued.notify_all();
+    for (std::thread *worker: _workers)
+    {
+        worker->join();
+        delete worker;
+    }
+    _workers.clear();
+    _fetched.close();
+    _writer->join();
+    delete _writer;
+    _writer = NULL;
+    return !_failed;
+}
+
+void ReferenceFetcher::fetch()
+{
+    for (;;)
+    {
+        // step 1: take as many queued ids as fit in one request
+        Batch batch;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _queued.wait(lock, [this]()
+                {
+                    return _finishing || !_pending.empty();
+                });
+            if (_pending.empty())
+                return;
+            while (!_pending.empty() && batch.ids.size() < MAX_IDS_PER_REQUEST)
+            {
+                batch.ids.push_back(_pending.front());
+                _pending.pop_front();
+            }
+        }
+
+        // step 2: request them, dropping the batch once cancelled
+        std::stringstream ssURL;
+        ssURL << "/works?mailto=" << _email
+              << "&per-page=200&select=" << WorksParser::FIELDS
+              << "&filter=language:en,ids.openalex:";
+        for (size_t i = 0; i < batch.ids.size(); i++)
+        {
+            if (i > 0)
+                ssURL << "|";
+            ssURL << Publication::convertId(batch.ids[i], 'W');
+        }
+        std::string body;
+        if (!_client->get(ssURL.str(), body, _cancelled))
+            continue;
+        WorksParser parser(batch.refs);
+        if (!nlohmann::json::sax_parse(body, &parser))
+        {
+            logError("Invalid page from OpenAlex");
+            std::lock_guard<std::mutex> lock(_mutex);
+            _failed = true;
+            continue;
+        }
+        _fetched.push(std::move(batch));
+    }
+}
+
+void ReferenceFetcher::write()
+{
+    std::map<uint64_t, Publication> refs;
+    std::vector<uint64_t> ids;
+    Batch batch;
+    while (_fetched.pop(batch))
+    {
+        refs.insert(batch.refs.begin(), batch.refs.end());
+        ids.insert(ids.end(), batch.ids.begin(), batch.ids.end());
+        if (refs.size() >= BATCH_SIZE)
+        {
+            save(refs, ids);
+            refs.clear();
+            ids.clear();
+        }
+    }
+    save(refs, ids);
+}
+
+// save fetched references, then write the tokens of the combination-years having all of theirs saved
+bool ReferenceFetcher::save(const std::map<uint64_t, Publication> &refs, const std::vector<uint64_t> &ids)
+{
+    if (ids.empty())
+        return true;
+    if (!refs.empty() && !_scope.save(refs))
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _failed = true;
+        return false;
+    }
+    std::vector<Waiting> completed;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _saved.insert(ids.begin(), ids.end());
+        for (auto waiting = _waiting.begin(); waiting != _waiting.end();)
+        {
+            for (uint64_t id: ids)
+            {
+                waiting->refIds.erase(id);
+            }
+            if (waiting->refIds.empty())
+            {
+                completed.push_back(*waiting);
+                waiting = _waiting.erase(waiting);
+            }
+            else
+            {
+                waiting++;
+            }
+        }
+    }
+    for (Waiting &waiting: completed)
+    {
+        if (!_scope.save(waiting.idxComb, waiting.y))
+            return false;
+    }
+    return true;
+}
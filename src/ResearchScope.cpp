@@ -3,59 +3,108 @@
 #include <stdexcept>
 #include <string>
 #include <sstream>
+#include <functional>
+#include <fstream>
 #include <StringProcessing.h>
 #include <sqlite3.h>
 #include <time.h>
-#include <CallbackData.h>
+#include <Statement.h>
+#include <Transaction.h>
+#include <IdSet.h>
 #include <wxFFileLog.h>
+#include <GeneralConfig.h>
 #include <BitermWeight.h>
 #include <TopicIdentification.h>
 
+static const char *WORK_SQL = "INSERT OR IGNORE INTO openalex_query_works(combination_id,year,work_id) VALUES (?,?,?);";
+static const char *REF_SQL = "INSERT OR IGNORE INTO openalex_query_refs(combination_id,year,ref_id) VALUES (?,?,?);";
+
+std::atomic<bool> ResearchScope::_searchUnavailable(false);
+
 std::vector<std::string> ResearchScope::getResearchScopes(const std::string path)
 {
     std::vector<std::string> results;
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + path));
+    std::shared_ptr<Database> database = Database::open(path, true);
+    Statement stmt(database->prepare("SELECT keywords FROM research_scopes ORDER BY update_time ASC;"));
+    if (!stmt.ok())
         return results;
+    while (stmt.step())
+    {
+        results.push_back(stmt.getString(0));
     }
+    if (!stmt.done())
+        logDebug(stmt.errorMessage());
+    return results;
+}
 
-    const char *sql = "SELECT keywords FROM research_scopes ORDER BY update_time ASC;";
-    CallbackData data;
-    char *errorMessage = NULL;
-    logDebug(sql);
-    rc = sqlite3_exec(db, sql, CallbackData::sqliteCallback, &data, &errorMessage);
-    if (rc == SQLITE_OK)
+// turn free text into an fts5 query matching all of its words, each quoted so that punctuation is not taken for query syntax
+static std::string toMatchQuery(const std::string &text)
+{
+    std::string query;
+    std::istringstream words(text);
+    std::string word;
+    while (words >> word)
     {
-        for (auto &result: data.results)
+        if (!query.empty())
+            query += " ";
+        query += "\"";
+        for (char ch: word)
         {
-            results.push_back(result["keywords"]);
+            if (ch == '"')
+                query += "\"";
+            query += ch;
         }
+        query += "\"";
     }
-    else
+    return query;
+}
+
+// find the publications whose title or abstract contain all words of the text, best ranked first
+bool ResearchScope::search(const std::string path, const std::string &text, int limit, std::vector<uint64_t> &ids)
+{
+    ids.clear();
+    std::string query = toMatchQuery(text);
+    if (query.empty())
+        return true;
+    std::shared_ptr<Database> database = Database::open(path, true);
+    Statement stmt(database->prepare("SELECT rowid FROM publications_fts WHERE publications_fts MATCH ? ORDER BY rank LIMIT ?;"));
+    if (!stmt.ok())
+        return false;
+    stmt.bind(1, query);
+    stmt.bind(2, limit);
+    while (stmt.step())
     {
-        logDebug(errorMessage);
+        ids.push_back(stmt.getUInt64(0));
     }
-    sqlite3_close(db);
-    return results;
+    if (!stmt.done())
+    {
+        logError(stmt.errorMessage());
+        return false;
+    }
+    return true;
 }
 
 ResearchScope::ResearchScope(const std::string path, const std::string kws1, const std::string kws2)
 {
     //ctor
     _path = path;
+    _db = Database::open(path);
     _kws1 = splitString(normalize(kws1), ",");
     _kws2 = splitString(normalize(kws2), ",");
     std::sort(_kws1.begin(), _kws1.end());
     std::sort(_kws2.begin(), _kws2.end());
+    if (!storable())
+        logError("Cannot create the tables of %s", path.c_str());
+    _partition = openPartition(false);
+    _refCache = ReferenceCache::open(path, getKeywords());
+    _dict = TermDictionary::open(_partition->path(), getKeywords());
 }
 
-ResearchScope::ResearchScope(const std::string path, const std::string keywords)
+ResearchScope::ResearchScope(const std::string path, const std::string keywords, bool readOnly)
 {
     //ctor
     _path = path;
+    _db = Database::open(path, readOnly);
     std::vector<std::string> kws = splitString(keywords,";");
     if (kws.size() != 2)
         throw std::invalid_argument("invalid keywords");
@@ -63,127 +112,274 @@ ResearchScope::ResearchScope(const std::string path, const std::string keywords)
     _kws2 = splitString(kws[1], ",");
     std::sort(_kws1.begin(), _kws1.end());
     std::sort(_kws2.begin(), _kws2.end());
+    if (!readOnly && !storable())
+        logError("Cannot create the tables of %s", path.c_str());
+    _partition = openPartition(readOnly);
+    _refCache = ReferenceCache::open(path, getKeywords());
+    _dict = TermDictionary::open(_partition->path(), getKeywords());
 }
 
 ResearchScope::~ResearchScope()
 {
     //dtor
+    flush();
 }
 
-Publication ResearchScope::getPublication(uint64_t id)
+sqlite3 *ResearchScope::db() const
 {
-    Publication noPub;
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(_path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + _path));
-        return noPub;
-    }
-    char *errorMessage = NULL;
+    return _db->handle();
+}
+
+std::shared_ptr<Database> ResearchScope::database() const
+{
+    return _db;
+}
+
+sqlite3_stmt *ResearchScope::prepare(const std::string &sql) const
+{
+    return _db->prepare(sql);
+}
 
+sqlite3 *ResearchScope::partitionDb() const
+{
+    return _partition->handle();
+}
+
+sqlite3_stmt *ResearchScope::preparePartition(const std::string &sql) const
+{
+    return _partition->prepare(sql);
+}
+
+std::shared_ptr<TermDictionary> ResearchScope::dictionary() const
+{
+    return _dict;
+}
+
+// save derived rows on the writer of the partition while the caller goes on, the job owning the data it writes
+void ResearchScope::saveLater(std::function<bool()> job)
+{
+    if (!_writer)
+        _writer = WriteBehind::open(_partition);
+    _writer->push(std::move(job));
+}
+
+// wait for the rows handed to saveLater, so that they can be read back
+bool ResearchScope::flush()
+{
+    if (!_writer)
+        return true;
+    return _writer->flush();
+}
+
+// get the path of a file of year y kept next to the database, such as a feature snapshot, named after a hash of the keywords
+std::string ResearchScope::getSnapshotPath(const std::string &name, const int y) const
+{
     std::stringstream ss;
-    ss << "SELECT id, year, title, abstract, source, language, authors, ref_ids FROM publications WHERE id = " << id << ";";
-    std::string sqlStr = ss.str();
-    logDebug(sqlStr.c_str());
-    CallbackData data;
-    rc = sqlite3_exec(db, sqlStr.c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-    if (rc != SQLITE_OK)
-    {
-        logError(errorMessage);
-        sqlite3_close(db);
-        return noPub;
-    }
-    if (data.results.size() == 0)
+    ss << _path << "." << name << "-" << std::hex << std::hash<std::string>()(getKeywords()) << std::dec << "-" << y << ".snap";
+    return ss.str();
+}
+
+// get the path of the database file holding the rows the stages derive for a scope, named like its snapshots
+std::string ResearchScope::getPartitionPath(const std::string path, const std::string keywords)
+{
+    std::stringstream ss;
+    ss << path << ".scope-" << std::hex << std::hash<std::string>()(keywords) << std::dec << ".sqlite";
+    return ss.str();
+}
+
+// get the database the stages of this scope keep their rows in. A scope uses its own file once it exists,
+// and a new one gets a file if partitions are on. Scopes analysed before keep using the shared database
+// until maintenance moves their rows, so that nothing has to be computed again.
+std::shared_ptr<Database> ResearchScope::openPartition(bool readOnly)
+{
+    std::string partitionPath = getPartitionPath(_path, getKeywords());
+    std::ifstream partitionFile(partitionPath.c_str());
+    if (!partitionFile.good())
     {
-        logError("Publication not found.");
-        sqlite3_close(db);
-        return noPub;
+        GeneralConfig config;
+        if (readOnly || !config.getPartitions() || hasStageRows())
+            return _db;
     }
-    Publication temp(data.results[0]);
-    sqlite3_close(db);
-    return temp;
+    partitionFile.close();
+    std::shared_ptr<Database> partition = Database::open(partitionPath, readOnly);
+    if (partition->handle() == NULL)
+        return _db;
+    return partition;
 }
 
-std::vector<Publication> ResearchScope::getPublications(std::vector<uint64_t> ids)
+// whether term extraction, the first stage, has written rows of this scope to the shared database
+bool ResearchScope::hasStageRows()
 {
-    std::vector<Publication> pubs;
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(_path.c_str(), &db);
-    if (rc != SQLITE_OK)
+    const char *sqls[] =
     {
-        logError(wxT("Cannot open database at" + _path));
-        return pubs;
+        "SELECT 1 FROM scope_term_dict WHERE keywords = ? LIMIT 1;",
+        "SELECT 1 FROM scope_terms WHERE keywords = ? LIMIT 1;",
+    };
+    for (const char *sql: sqls)
+    {
+        Statement stmt(prepare(sql));
+        if (!stmt.ok())
+            continue; // the stage has never run
+        stmt.bind(1, getKeywords());
+        if (stmt.step())
+            return true;
     }
-    char *errorMessage = NULL;
+    return false;
+}
 
-    std::stringstream ss;
-    ss << "SELECT id, year, title, abstract, source, language, authors, ref_ids FROM publications WHERE id IN (";
-    for (size_t i = 0; i < ids.size(); i++)
+Publication ResearchScope::getPublication(uint64_t id, int fields)
+{
+    Publication noPub;
+    Statement stmt(prepare("SELECT " + Publication::columns(fields) + " FROM publications WHERE id = ?;"));
+    if (!stmt.ok())
+        return noPub;
+    stmt.bind(1, id);
+    if (!stmt.step())
     {
-        if (i > 0)
-            ss << ",";
-        ss << ids[i];
+        if (!stmt.done())
+            logError(stmt.errorMessage());
+        else
+            logError("Publication not found.");
+        return noPub;
     }
-    ss << ");";
-    std::string sqlStr = ss.str();
-    logDebug(sqlStr.c_str());
-    CallbackData data;
-    rc = sqlite3_exec(db, sqlStr.c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-    if (rc != SQLITE_OK)
-    {
-        logError(errorMessage);
-        sqlite3_close(db);
+    Publication pub(stmt);
+    return pub;
+}
+
+// get the given fields of the stored publications of the ids, in the order of the ids
+std::vector<Publication> ResearchScope::getPublications(std::vector<uint64_t> ids, int fields)
+{
+    std::vector<Publication> pubs;
+    IdSet idSet(_db, "pub_ids");
+    if (!idSet.insert(ids))
         return pubs;
+    std::map<uint64_t, Publication> pubOfId;
+    {
+        Statement stmt(prepare("SELECT " + Publication::columns(fields, "p") +
+                               " FROM temp.pub_ids s JOIN publications p ON p.id = s.id;"));
+        if (!stmt.ok())
+            return pubs;
+        while (stmt.step())
+        {
+            Publication pub(stmt);
+            pubOfId[pub.id()] = pub;
+        }
+        if (!stmt.done())
+        {
+            logError(stmt.errorMessage());
+            return pubs;
+        }
     }
-    for (auto &result: data.results)
+    for (uint64_t id: ids)
     {
-        Publication temp(result);
-        pubs.push_back(temp);
+        auto idToPub = pubOfId.find(id);
+        if (idToPub != pubOfId.end())
+            pubs.push_back(idToPub->second);
     }
-    sqlite3_close(db);
     return pubs;
 }
 
-std::vector<Publication> ResearchScope::getReferences(uint64_t id)
+std::vector<Publication> ResearchScope::getReferences(uint64_t id, int fields)
 {
-    Publication me = getPublication(id);
-    return getPublications(me.refIds());
+    Publication me = getPublication(id, PUB_REF_IDS);
+    return getPublications(me.refIds(), fields);
 }
 
-std::vector<Publication> ResearchScope::getCitations(uint64_t id, int ye)
+std::vector<Publication> ResearchScope::getCitations(uint64_t id, int ye, int fields)
 {
     std::vector<Publication> myCitations;
-    for (int y = ye - 15; y < ye; y++)
+    std::map<int, std::set<uint64_t>> citersOfYear;
+    if (!getCiters(id, ye - 15, ye, citersOfYear))
+        return myCitations;
+    for (auto &yToCiters: citersOfYear)
     {
-        std::map<uint64_t, std::vector<uint64_t>> refIdsOfId;
-        std::vector<uint64_t> myCitIds;
-        if (getExistingRefIds(y, refIdsOfId))
+        std::vector<uint64_t> myCitIds(yToCiters.second.begin(), yToCiters.second.end());
+        std::vector<Publication> temp = getPublications(myCitIds, fields);
+        for (Publication p: temp)
         {
-            for (auto idToRefIds: refIdsOfId)
-            {
-                for (uint64_t refId: idToRefIds.second)
-                {
-                    if (refId == id)
-                    {
-                        myCitIds.push_back(idToRefIds.first);
-                        break;
-                    }
-                }
-            }
-            if (myCitIds.size() > 0)
-            {
-                std::vector<Publication> temp = getPublications(myCitIds);
-                for (Publication p: temp)
-                {
-                    myCitations.push_back(p);
-                }
-            }
+            myCitations.push_back(p);
         }
     }
     return myCitations;
 }
 
+// find the works in the scope whose title or abstract contain all words of the text, best ranked first
+bool ResearchScope::search(const std::string &text, int limit, std::vector<uint64_t> &ids) const
+{
+    ids.clear();
+    std::string query = toMatchQuery(text);
+    if (query.empty())
+        return true;
+
+    // step 1: rank the matching works of every combination
+    std::map<uint64_t, double> rankOfId;
+    int numCombs = numCombinations();
+    for (int idxComb = 0; idxComb < numCombs; idxComb++)
+    {
+        Statement stmt(prepare("SELECT rowid, rank FROM publications_fts"
+                               " WHERE publications_fts MATCH ? AND rowid IN (SELECT w.work_id FROM openalex_query_works w"
+                               " JOIN openalex_combinations c ON c.id = w.combination_id WHERE c.combination = ?)"
+                               " ORDER BY rank LIMIT ?;"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, query);
+        stmt.bind(2, getCombination(idxComb));
+        stmt.bind(3, limit);
+        while (stmt.step())
+        {
+            rankOfId[stmt.getUInt64(0)] = stmt.getDouble(1);
+        }
+        if (!stmt.done())
+        {
+            logError(stmt.errorMessage());
+            return false;
+        }
+    }
+
+    // step 2: merge them, the lower rank the better
+    std::vector<std::pair<double, uint64_t>> ranked;
+    for (auto &idToRank: rankOfId)
+    {
+        ranked.push_back(std::pair<double, uint64_t>(idToRank.second, idToRank.first));
+    }
+    std::sort(ranked.begin(), ranked.end());
+    for (size_t i = 0; i < ranked.size() && (int)i < limit; i++)
+    {
+        ids.push_back(ranked[i].second);
+    }
+    return true;
+}
+
+// get the works in the scope published in [y0, y1) that cite the publication, grouped by their years
+bool ResearchScope::getCiters(uint64_t id, const int y0, const int y1, std::map<int, std::set<uint64_t>> &citersOfYear) const
+{
+    citersOfYear.clear();
+    int numCombs = numCombinations();
+    for (int idxComb = 0; idxComb < numCombs; idxComb++)
+    {
+        Statement stmt(prepare("SELECT ct.citing_id, ct.citing_year FROM citations ct"
+                               " JOIN openalex_query_works w ON w.work_id = ct.citing_id AND w.year = ct.citing_year"
+                               " JOIN openalex_combinations c ON c.id = w.combination_id"
+                               " WHERE ct.cited_id = ? AND ct.citing_year >= ? AND ct.citing_year < ? AND c.combination = ?;"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, id);
+        stmt.bind(2, y0);
+        stmt.bind(3, y1);
+        stmt.bind(4, getCombination(idxComb));
+        while (stmt.step())
+        {
+            citersOfYear[stmt.getInt(1)].insert(stmt.getUInt64(0));
+        }
+        if (!stmt.done())
+        {
+            logDebug(stmt.errorMessage());
+            return false;
+        }
+    }
+    return true;
+}
+
 std::pair<std::string,std::string> ResearchScope::getTopic(uint64_t id, int ye, TopicIdentification *ti)
 {
     std::map<uint64_t,std::pair<std::string,std::string>> topics;
@@ -196,7 +392,7 @@ std::pair<std::string,std::string> ResearchScope::getTopic(uint64_t id, int ye,
     return idToTopic->second;
 }
 
-std::vector<Publication> ResearchScope::getTopicPublications(uint64_t id, int ye, BitermWeight *bw, TopicIdentification *ti)
+std::vector<Publication> ResearchScope::getTopicPublications(uint64_t id, int ye, BitermWeight *bw, TopicIdentification *ti, int fields)
 {
     std::vector<Publication> noPubs;
     std::pair<std::string,std::string> myTopic = getTopic(id, ye, ti);
@@ -204,18 +400,22 @@ std::vector<Publication> ResearchScope::getTopicPublications(uint64_t id, int ye
         return noPubs;
 
     std::vector<std::string> biterms = splitString(myTopic.first,"|");
-    std::set<std::string> bitermSet(biterms.begin(),biterms.end());
+    std::set<Biterm> bitermSet;
+    for (auto &biterm: biterms)
+    {
+        bitermSet.insert(_dict->getBiterm(biterm));
+    }
 
     std::set<uint64_t> myTidSet;
     for (int y = ye - 15; y < ye; y++)
     {
-        std::map<uint64_t, std::map<std::string, double>> bws;
+        std::map<uint64_t, std::map<Biterm, double>> bws;
         if (bw->load(y, &bws))
         {
-            for (auto cidToBW: bws)
+            for (auto &cidToBW: bws)
             {
                 uint64_t cid = cidToBW.first;
-                for (auto bToW: cidToBW.second)
+                for (auto &bToW: cidToBW.second)
                 {
                     if (bitermSet.find(bToW.first) != bitermSet.end())
                     {
@@ -228,18 +428,15 @@ std::vector<Publication> ResearchScope::getTopicPublications(uint64_t id, int ye
     }
 
     std::vector<uint64_t> myTids(myTidSet.begin(), myTidSet.end());
-    return getPublications(myTids);
+    return getPublications(myTids, fields);
 }
 
 bool ResearchScope::storable()
 {
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(_path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + _path));
+    sqlite3 *db = _db->handle();
+    if (db == NULL)
         return false;
-    }
+    int rc = SQLITE_OK;
     char *errorMessage = NULL;
     const char*sqls[] =
     {
@@ -257,10 +454,43 @@ bool ResearchScope::storable()
         "combination TEXT,"
         "year INTEGER,"
         "update_time INTEGER,"
-        "ids TEXT,"
-        "ref_ids TEXT,"
         "PRIMARY KEY(combination,year));",
 
+        "CREATE TABLE IF NOT EXISTS openalex_combinations("
+        "id INTEGER PRIMARY KEY ASC,"
+        "combination TEXT UNIQUE);",
+
+        "CREATE TABLE IF NOT EXISTS openalex_query_works("
+        "combination_id INTEGER,"
+        "year INTEGER,"
+        "work_id INTEGER,"
+        "PRIMARY KEY(combination_id,year,work_id)) WITHOUT ROWID;",
+
+        "CREATE INDEX IF NOT EXISTS openalex_query_works_work_id ON openalex_query_works(work_id);",
+
+        "CREATE TABLE IF NOT EXISTS openalex_query_refs("
+        "combination_id INTEGER,"
+        "year INTEGER,"
+        "ref_id INTEGER,"
+        "PRIMARY KEY(combination_id,year,ref_id)) WITHOUT ROWID;",
+
+        "CREATE INDEX IF NOT EXISTS openalex_query_refs_ref_id ON openalex_query_refs(ref_id);",
+
+        "CREATE TABLE IF NOT EXISTS pub_tokens("
+        "id INTEGER,"
+        "field INTEGER,"
+        "tokens BLOB,"
+        "PRIMARY KEY(id,field)) WITHOUT ROWID;",
+
+        "CREATE TABLE IF NOT EXISTS openalex_cursors("
+        "combination_id INTEGER,"
+        "year INTEGER,"
+        "combination TEXT,"
+        "cursor TEXT,"
+        "num_works INTEGER,"
+        "update_time INTEGER,"
+        "PRIMARY KEY(combination_id,year)) WITHOUT ROWID;",
+
         "CREATE TABLE IF NOT EXISTS openalex_tokens("
         "combination TEXT,"
         "year INTEGER,"
@@ -279,15 +509,283 @@ bool ResearchScope::storable()
         if (rc != SQLITE_OK)
         {
             logError(errorMessage);
-            sqlite3_close(db);
             return false;
         }
     }
 
-    sqlite3_close(db);
     return true;
 }
 
+// whether the tables derived from those of older versions are built, which upgrade() does otherwise
+bool ResearchScope::upgraded()
+{
+    return queriesUpgraded() && hasTable("citations") && searchIndexed();
+}
+
+// build the tables derived from those of older versions; it takes minutes on a large database, so the task
+// thread does it before the first crawl rather than the constructor on the GUI thread
+bool ResearchScope::upgrade()
+{
+    if (!upgradeQueries())
+        return false;
+    if (!hasTable("citations") && !upgradeCitations())
+        return false;
+    createSearchIndex();
+    return true;
+}
+
+bool ResearchScope::hasTable(const std::string &name)
+{
+    Statement stmt(prepare("SELECT name FROM sqlite_master WHERE type = 'table' AND name = ?;"));
+    if (!stmt.ok())
+        return false;
+    stmt.bind(1, name);
+    if (!stmt.step())
+    {
+        if (!stmt.done())
+            logError(stmt.errorMessage());
+        return false;
+    }
+    return true;
+}
+
+// whether the publications are indexed for full-text search, or cannot be by this build of the library
+bool ResearchScope::searchIndexed()
+{
+    return _searchUnavailable.load() || hasTable("publications_fts");
+}
+
+// index the titles and abstracts of the publications for full-text search, with triggers keeping the index
+// in step with every publication saved or pruned afterwards, inside the same transaction. Indexing a large
+// database takes minutes, so the task thread does it rather than the constructor, and search is not needed
+// by the pipeline, so a library built without fts5 only disables it, which is then not tried again
+bool ResearchScope::createSearchIndex()
+{
+    if (searchIndexed())
+        return true;
+    sqlite3 *db = _db->handle();
+    if (db == NULL)
+        return false;
+    const char*sqls[] =
+    {
+        "CREATE VIRTUAL TABLE IF NOT EXISTS publications_fts USING fts5("
+        "title, abstract, content='publications', content_rowid='id', tokenize='porter unicode61');",
+
+        "CREATE TRIGGER IF NOT EXISTS publications_fts_insert AFTER INSERT ON publications BEGIN"
+        " INSERT INTO publications_fts(rowid, title, abstract) VALUES (new.id, new.title, new.abstract);"
+        " END;",
+
+        "CREATE TRIGGER IF NOT EXISTS publications_fts_delete AFTER DELETE ON publications BEGIN"
+        " INSERT INTO publications_fts(publications_fts, rowid, title, abstract) VALUES ('delete', old.id, old.title, old.abstract);"
+        " END;",
+
+        "CREATE TRIGGER IF NOT EXISTS publications_fts_update AFTER UPDATE OF title, abstract ON publications BEGIN"
+        " INSERT INTO publications_fts(publications_fts, rowid, title, abstract) VALUES ('delete', old.id, old.title, old.abstract);"
+        " INSERT INTO publications_fts(rowid, title, abstract) VALUES (new.id, new.title, new.abstract);"
+        " END;",
+
+        "INSERT INTO publications_fts(publications_fts) VALUES ('rebuild');",
+    };
+    logMessage("Building the full-text index of publications.");
+    Transaction tx(db);
+    if (!tx.ok())
+        return false;
+    char *errorMessage = NULL;
+    for (const char*sql: sqls)
+    {
+        logDebug(sql);
+        int rc = sqlite3_exec(db, sql, NULL, NULL, &errorMessage);
+        if (rc != SQLITE_OK)
+        {
+            logError(errorMessage);
+            sqlite3_free(errorMessage);
+            if (sql == sqls[0])
+                _searchUnavailable.store(true);
+            return false;
+        }
+    }
+    return tx.commit();
+}
+
+// create the citations table filled from the comma-separated ref_ids of the publications stored by older
+// versions, in one transaction, so that the table exists only once it holds every citation
+bool ResearchScope::upgradeCitations()
+{
+    sqlite3 *db = _db->handle();
+    if (db == NULL)
+        return false;
+    const char*sqls[] =
+    {
+        "CREATE TABLE IF NOT EXISTS citations("
+        "citing_id INTEGER,"
+        "cited_id INTEGER,"
+        "citing_year INTEGER,"
+        "PRIMARY KEY(citing_id,cited_id)) WITHOUT ROWID;",
+
+        "CREATE INDEX IF NOT EXISTS citations_cited_id ON citations(cited_id,citing_year);",
+
+        "WITH RECURSIVE refs(citing_id, citing_year, cited_id, rest) AS ("
+        "SELECT id, year, '', ref_ids || ',' FROM publications WHERE ref_ids <> ''"
+        " UNION ALL "
+        "SELECT citing_id, citing_year, substr(rest, 1, instr(rest, ',') - 1), substr(rest, instr(rest, ',') + 1)"
+        " FROM refs WHERE rest <> '')"
+        "INSERT OR IGNORE INTO citations(citing_id,cited_id,citing_year)"
+        " SELECT citing_id, CAST(cited_id AS INTEGER), citing_year FROM refs WHERE cited_id <> '';",
+    };
+    logMessage("Building the citations table.");
+    Transaction tx(db);
+    if (!tx.ok())
+        return false;
+    char *errorMessage = NULL;
+    for (const char*sql: sqls)
+    {
+        logDebug(sql);
+        int rc = sqlite3_exec(db, sql, NULL, NULL, &errorMessage);
+        if (rc != SQLITE_OK)
+        {
+            logError(errorMessage);
+            sqlite3_free(errorMessage);
+            return false;
+        }
+    }
+    return tx.commit();
+}
+
+// whether openalex_queries has lost the columns of older versions, false also if that cannot be told
+bool ResearchScope::queriesUpgraded()
+{
+    Statement stmt(prepare("SELECT name FROM pragma_table_info('openalex_queries') WHERE name = 'ids';"));
+    if (!stmt.ok())
+        return false;
+    if (stmt.step())
+        return false;
+    if (!stmt.done())
+    {
+        logError(stmt.errorMessage());
+        return false;
+    }
+    return true;
+}
+
+// move the comma-separated ids and ref_ids of openalex_queries written by older versions into the membership tables
+bool ResearchScope::upgradeQueries()
+{
+    sqlite3 *db = _db->handle();
+    if (db == NULL)
+        return false;
+    int rc = SQLITE_OK;
+    char *errorMessage = NULL;
+
+    // ---------------------------------------------------------------------------
+    // step 1: check whether openalex_queries still has the old columns
+    if (queriesUpgraded())
+        return true;
+
+    logMessage("Migrating openalex_queries to membership tables.");
+    Transaction tx(db);
+    if (!tx.ok())
+        return false;
+
+    // ---------------------------------------------------------------------------
+    // step 2: copy ids and ref ids of every combination and year
+    {
+        Statement stmt(prepare("SELECT combination, year, ids, ref_ids FROM openalex_queries;"));
+        if (!stmt.ok())
+            return false;
+        while (stmt.step())
+        {
+            int64_t combinationId = getCombinationId(stmt.getString(0), true);
+            int y = stmt.getInt(1);
+            if (combinationId == 0)
+                return false;
+            meta::util::string_view text = stmt.getText(2);
+            meta::util::string_view field;
+            while (nextField(text, ',', field))
+            {
+                if (!saveMember(WORK_SQL, combinationId, y, toUInt64(field)))
+                    return false;
+            }
+            text = stmt.getText(3);
+            while (nextField(text, ',', field))
+            {
+                if (!saveMember(REF_SQL, combinationId, y, toUInt64(field)))
+                    return false;
+            }
+        }
+        if (!stmt.done())
+        {
+            logError(stmt.errorMessage());
+            return false;
+        }
+    }
+
+    // ---------------------------------------------------------------------------
+    // step 3: drop the old columns
+    const char*sqls[] =
+    {
+        "ALTER TABLE openalex_queries DROP COLUMN ids;",
+        "ALTER TABLE openalex_queries DROP COLUMN ref_ids;",
+    };
+    for (const char*sql: sqls)
+    {
+        logDebug(sql);
+        rc = sqlite3_exec(db, sql, NULL, NULL, &errorMessage);
+        if (rc != SQLITE_OK)
+        {
+            logError(errorMessage);
+            return false;
+        }
+    }
+    return tx.commit();
+}
+
+bool ResearchScope::saveMember(const char *sql, int64_t combinationId, const int y, uint64_t id)
+{
+    Statement stmt(prepare(sql));
+    if (!stmt.ok())
+        return false;
+    stmt.bind(1, combinationId);
+    stmt.bind(2, y);
+    stmt.bind(3, id);
+    stmt.step();
+    if (!stmt.done())
+    {
+        logError(stmt.errorMessage());
+        return false;
+    }
+    return true;
+}
+
+// get the id of a combination in openalex_combinations, optionally adding it, or 0 if it is unknown
+int64_t ResearchScope::getCombinationId(const std::string &combination, bool create)
+{
+    if (create)
+    {
+        Statement stmt(prepare("INSERT OR IGNORE INTO openalex_combinations(combination) VALUES (?);"));
+        if (!stmt.ok())
+            return 0;
+        stmt.bind(1, combination);
+        stmt.step();
+        if (!stmt.done())
+        {
+            logError(stmt.errorMessage());
+            return 0;
+        }
+    }
+
+    Statement stmt(prepare("SELECT id FROM openalex_combinations WHERE combination = ?;"));
+    if (!stmt.ok())
+        return 0;
+    stmt.bind(1, combination);
+    if (!stmt.step())
+    {
+        if (!stmt.done())
+            logError(stmt.errorMessage());
+        return 0;
+    }
+    return (int64_t)stmt.getUInt64(0);
+}
+
 std::string ResearchScope::getKeywords() const
 {
     std::stringstream ss;
@@ -350,37 +848,27 @@ std::string ResearchScope::getCombination(int i) const
 
 int ResearchScope::numPublications(const int y) const
 {
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(_path.c_str(), &db);
-    if (rc != SQLITE_OK)
-        return false;
-
     std::set<uint64_t> ids;
     int numCombs = numCombinations();
     for (int idxComb = 0; idxComb < numCombs; idxComb++)
     {
-        CallbackData data;
-        char *errorMessage = NULL;
-        std::stringstream ss;
-        ss << "SELECT combination, year, ids FROM openalex_queries"
-           " WHERE combination = '" << getCombination(idxComb) << "' AND year = " << y << ";";
-        logDebug(ss.str().c_str());
-        rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
+        Statement stmt(prepare("SELECT w.work_id FROM openalex_query_works w"
+                               " JOIN openalex_combinations c ON c.id = w.combination_id"
+                               " WHERE c.combination = ? AND w.year = ?;"));
+        if (!stmt.ok())
+            return 0;
+        stmt.bind(1, getCombination(idxComb));
+        stmt.bind(2, y);
+        while (stmt.step())
         {
-            logDebug(errorMessage);
+            ids.insert(stmt.getUInt64(0));
         }
-        if (data.results.size() > 0)
+        if (!stmt.done())
         {
-            std::vector<std::string> idStrs = splitString(data.results[0]["ids"], ",");
-            for (std::string idStr: idStrs)
-            {
-                ids.insert(std::stoull(idStr));
-            }
+            logDebug(stmt.errorMessage());
         }
     }
 
-    sqlite3_close(db);
     return (int)ids.size();
 }
 
@@ -389,232 +877,220 @@ bool ResearchScope::init()
     if (!storable())
         return false;
 
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(_path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + _path));
+    Statement stmt(prepare("INSERT OR IGNORE INTO research_scopes(keywords,combinations,update_time) VALUES(?,?,?);"));
+    if (!stmt.ok())
         return false;
-    }
-    CallbackData data;
-    char *errorMessage = NULL;
 
     std::string keywords = getKeywords();
     std::string combinations = getCombinations();
     time_t t;
     time(&t);
-    std::stringstream ss;
-    ss << "INSERT OR IGNORE INTO research_scopes(keywords,combinations,update_time) VALUES('"
-       << keywords << "','" << combinations << "'," << (int)t
-       << ");";
-    std::string sql = ss.str();
-    logDebug(sql.c_str());
-    rc = sqlite3_exec(db, sql.c_str(), NULL, NULL, &errorMessage);
-    sqlite3_close(db);
-    if (rc != SQLITE_OK)
+    stmt.bind(1, keywords);
+    stmt.bind(2, combinations);
+    stmt.bind(3, (int)t);
+    stmt.step();
+    if (!stmt.done())
     {
-        logError(errorMessage);
+        logError(stmt.errorMessage());
+        return false;
     }
-    return rc == SQLITE_OK;
+    return true;
 }
 
-bool ResearchScope::load(int idxComb, const int y, std::map<uint64_t, Publication> &pubsOfY)
+bool ResearchScope::load(int idxComb, const int y, std::map<uint64_t, Publication> &pubsOfY, int fields)
 {
     pubsOfY.clear();
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(_path.c_str(), &db);
-    if (rc != SQLITE_OK)
+    if (!queried(idxComb, y))
         return false;
-    CallbackData data;
-    char *errorMessage = NULL;
 
+    Statement stmt(prepare("SELECT " + Publication::columns(fields, "p") +
+                           " FROM openalex_query_works w"
+                           " JOIN openalex_combinations c ON c.id = w.combination_id"
+                           " JOIN publications p ON p.id = w.work_id"
+                           " WHERE c.combination = ? AND w.year = ?;"));
+    if (!stmt.ok())
+        return false;
+    stmt.bind(1, getCombination(idxComb));
+    stmt.bind(2, y);
+    while (stmt.step())
     {
-        std::stringstream ss;
-        ss << "SELECT combination, year, ids FROM openalex_queries"
-           " WHERE combination = '" << getCombination(idxComb) << "' AND year = " << y << ";";
-        logDebug(ss.str().c_str());
-        rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logDebug(errorMessage);
-        }
-        if (rc != SQLITE_OK || data.results.size() == 0)
-        {
-            sqlite3_close(db);
-            return false;
-        }
+        Publication pub(stmt);
+        pubsOfY[pub.id()] = pub;
     }
+    if (!stmt.done())
+    {
+        logDebug(stmt.errorMessage());
+        return false;
+    }
+    return true;
+}
 
-
+// whether the works of every combination in year y have been saved
+bool ResearchScope::queried(const int y) const
+{
+    int numCombs = numCombinations();
+    for (int idxComb = 0; idxComb < numCombs; idxComb++)
     {
-        std::stringstream ss;
-        std::string strIds = data.results[0]["ids"];
-        data.results.clear();
-        ss << "SELECT id, year, title, abstract, source, language, authors, ref_ids FROM publications WHERE id in ("
-           << strIds << ");";
-        logDebug(ss.str().c_str());
-        rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logDebug(errorMessage);
-            sqlite3_close(db);
+        if (!queried(idxComb, y))
             return false;
-        }
     }
+    return true;
+}
 
-
-    for (auto &result: data.results)
+// whether the works of the combination and year have been saved
+bool ResearchScope::queried(int idxComb, const int y) const
+{
+    Statement stmt(prepare("SELECT year FROM openalex_queries WHERE combination = ? AND year = ?;"));
+    if (!stmt.ok())
+        return false;
+    stmt.bind(1, getCombination(idxComb));
+    stmt.bind(2, y);
+    if (!stmt.step())
     {
-        Publication pub(result);
-        pubsOfY[pub.id()] = pub;
+        if (!stmt.done())
+            logDebug(stmt.errorMessage());
+        return false;
     }
-    sqlite3_close(db);
     return true;
 }
 
 bool ResearchScope::load(int idxComb, const int y)
 {
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(_path.c_str(), &db);
-    if (rc != SQLITE_OK)
+    Statement stmt(prepare("SELECT year FROM openalex_tokens WHERE combination = ? AND year = ?;"));
+    if (!stmt.ok())
         return false;
-    CallbackData data;
-    char *errorMessage = NULL;
-
-    std::stringstream ss;
-    ss << "SELECT combination, year FROM openalex_tokens"
-       " WHERE combination = '" << getCombination(idxComb) << "' AND year = " << y << ";";
-    logDebug(ss.str().c_str());
-    rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-    if (rc != SQLITE_OK)
+    stmt.bind(1, getCombination(idxComb));
+    stmt.bind(2, y);
+    if (!stmt.step())
     {
-        logDebug(errorMessage);
-    }
-    if (rc != SQLITE_OK || data.results.size() == 0)
-    {
-        sqlite3_close(db);
+        if (!stmt.done())
+            logDebug(stmt.errorMessage());
         return false;
     }
-    sqlite3_close(db);
     return true;
 }
 
 bool ResearchScope::save(const std::map<uint64_t, Publication> &pubs)
 {
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(_path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + _path));
+    std::set<int> changedYears;
+    if (!save(pubs, changedYears))
         return false;
+    for (int y: changedYears)
+    {
+        _refCache->invalidate(y);
     }
-    CallbackData data;
-    char *errorMessage = NULL;
+    return true;
+}
 
-    // ---------------------------------------------------------------------------
-    // step 1: find old ids
+// save publications, collecting the years whose existing references they change
+bool ResearchScope::save(const std::map<uint64_t, Publication> &pubs, std::set<int> &changedYears)
+{
+    sqlite3 *db = _db->handle();
+    Transaction tx(db);
+    if (!tx.ok())
+        return false;
+
+    Statement stmt(prepare("INSERT OR IGNORE INTO publications(id, year, title, abstract, source, language, authors, ref_ids)"
+                           " VALUES (?,?,?,?,?,?,?,?);"));
+    if (!stmt.ok())
+        return false;
+    std::vector<uint64_t> newIds;
+    for (auto &idToPub: pubs)
     {
-        std::stringstream ss;
-        ss << "SELECT id FROM publications where id in (";
-        int iPub = 0;
-        for (auto idToPub: pubs)
+        Publication pub = idToPub.second;
+        std::stringstream ssAuthors;
+        const std::vector<wxString> &authors = pub.authors();
+        for (size_t i = 0; i < authors.size(); i++)
         {
-            if (iPub++ > 0)
-                ss << ",";
-            ss << idToPub.first;
+            if (i > 0)
+                ssAuthors << ",";
+            ssAuthors << authors[i].ToStdString();
         }
-        ss << ");";
-        logDebug(ss.str().c_str());
-        rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
+        std::stringstream ssRefIds;
+        const std::vector<uint64_t> &refIds = pub.refIds();
+        for (size_t i = 0; i < refIds.size(); i++)
+        {
+            if (i > 0)
+                ssRefIds << ",";
+            ssRefIds << refIds[i];
+        }
+        stmt.bind(1, pub.id());
+        stmt.bind(2, pub.year());
+        stmt.bind(3, pub.title().ToStdString());
+        stmt.bind(4, pub.abstract().ToStdString());
+        stmt.bind(5, pub.source().ToStdString());
+        stmt.bind(6, pub.language().ToStdString());
+        stmt.bind(7, ssAuthors.str());
+        stmt.bind(8, ssRefIds.str());
+        if (!stmt.execute())
         {
-            logDebug(errorMessage);
-            sqlite3_close(db);
+            logError(stmt.errorMessage());
             return false;
         }
-    }
 
-    if (data.results.size() == pubs.size())
-    {
-        sqlite3_close(db);
-        return true;
-    }
-
-    std::set<uint64_t> oldIdSet;
-    for (auto result: data.results)
-    {
-        oldIdSet.insert(std::stoull(result["id"]));
+        // only a publication with a new id brings new citations, and becomes an existing reference of its citers
+        if (sqlite3_changes(db) > 0)
+        {
+            if (!saveCitations(pub))
+                return false;
+            newIds.push_back(pub.id());
+        }
+        if (!tx.step())
+            return false;
     }
+    if (!getCitingYears(newIds, changedYears))
+        return false;
+    return tx.commit();
+}
 
-    // ---------------------------------------------------------------------------
-    // step 2: insert publications with new ids
+bool ResearchScope::saveCitations(Publication &pub)
+{
+    Statement stmt(prepare("INSERT OR IGNORE INTO citations(citing_id,cited_id,citing_year) VALUES (?,?,?);"));
+    if (!stmt.ok())
+        return false;
+    const std::vector<uint64_t> &refIds = pub.refIds();
+    for (uint64_t refId: refIds)
     {
-        std::stringstream ss;
-        ss << "INSERT OR IGNORE INTO publications(id, year, title, abstract, source, language, authors, ref_ids) VALUES ";
-        int iPub = 0;
-        for (auto idToPub: pubs)
-        {
-            if (oldIdSet.find(idToPub.first) != oldIdSet.end())
-                continue;
-
-            if (iPub++ > 0)
-                ss << ",";
-
-            ss << "("
-               << idToPub.second.id() << ","
-               << idToPub.second.year() << ",'"
-               << idToPub.second.title() << "','"
-               << idToPub.second.abstract() << "','"
-               << idToPub.second.source() << "','"
-               << idToPub.second.language() << "','";
-
-            const std::vector<wxString> &authors = idToPub.second.authors();
-            for (size_t i = 0; i < authors.size(); i++)
-            {
-                if (i > 0)
-                    ss << ",";
-                ss << authors[i];
-            }
-            ss << "','";
-
-            std::vector<uint64_t> refIds = idToPub.second.refIds();
-            for (size_t i = 0; i < refIds.size(); i++)
-            {
-                if (i > 0)
-                    ss << ",";
-                ss << refIds[i];
-            }
-            ss << "')";
-        }
-        ss << ";";
-        rc = sqlite3_exec(db, ss.str().c_str(), NULL, NULL, &errorMessage);
-        if (rc != SQLITE_OK)
+        stmt.bind(1, pub.id());
+        stmt.bind(2, refId);
+        stmt.bind(3, pub.year());
+        if (!stmt.execute())
         {
-            logError(errorMessage);
-            sqlite3_close(db);
+            logError(stmt.errorMessage());
             return false;
         }
     }
-
-
-    sqlite3_close(db);
     return true;
 }
 
-bool ResearchScope::save(int idxComb, const int y, const std::map<uint64_t, Publication> &pubsOfY)
+// get the years of the works citing any of the publications
+bool ResearchScope::getCitingYears(const std::vector<uint64_t> &ids, std::set<int> &citingYears)
 {
-    save(pubsOfY);
-
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(_path.c_str(), &db);
-    if (rc != SQLITE_OK)
+    if (ids.empty())
+        return true;
+    IdSet idSet(_db, "cited_ids");
+    if (!idSet.insert(ids))
+        return false;
+    Statement stmt(prepare("SELECT DISTINCT ct.citing_year FROM temp.cited_ids s"
+                           " JOIN citations ct ON ct.cited_id = s.id;"));
+    if (!stmt.ok())
+        return false;
+    while (stmt.step())
     {
-        logError(wxT("Cannot open database at" + _path));
+        citingYears.insert(stmt.getInt(0));
+    }
+    if (!stmt.done())
+    {
+        logError(stmt.errorMessage());
         return false;
     }
-    CallbackData data;
-    char *errorMessage = NULL;
+    return true;
+}
 
+// save a batch of the works of a combination in year y, the last batch with queried marking all of them saved,
+// and the others with the cursor of the page after the last one whose works are all saved, if it moved
+bool ResearchScope::save(int idxComb, const int y, const std::map<uint64_t, Publication> &pubsOfY, bool queried, const std::string &cursor)
+{
     // ---------------------------------------------------------------------------
     // step 1: get ref ids
     std::set<uint64_t> refIds;
@@ -625,263 +1101,246 @@ bool ResearchScope::save(int idxComb, const int y, const std::map<uint64_t, Publ
     }
 
     // ---------------------------------------------------------------------------
-    // step 2: save ids and ref ids
-    std::string combination = getCombination(idxComb);
-    time_t t;
-    time(&t);
-    std::stringstream ss;
-    ss << "INSERT OR IGNORE INTO openalex_queries(combination,year,update_time,ids,ref_ids) VALUES ('"
-       << combination << "'," << y << "," << (int) t << ",'";
-    int iPub = 0;
-    for (auto idToPub: pubsOfY)
-    {
-        if (iPub++ > 0)
-            ss << ",";
-        ss << idToPub.first;
-    }
-    ss << "','";
-    int iRef = 0;
-    for (uint64_t refId: refIds)
+    // step 2: save publications, ids and ref ids together with the query marking them saved
+    std::set<int> changedYears;
+    changedYears.insert(y);
     {
-        if (iRef++ > 0)
-            ss << ",";
-        ss << refId;
+        Transaction tx(_db->handle());
+        if (!tx.ok())
+            return false;
+        if (!save(pubsOfY, changedYears))
+            return false;
+        if (!saveMembers(idxComb, y, pubsOfY, refIds, queried, cursor))
+            return false;
+        if (!tx.commit())
+            return false;
     }
-    ss << "');";
-    logDebug(ss.str().c_str());
-    rc = sqlite3_exec(db, ss.str().c_str(), NULL, NULL, &errorMessage);
-    if (rc != SQLITE_OK)
+
+    // ---------------------------------------------------------------------------
+    // step 3: drop cached references of the changed years once the changes are visible
+    for (int yc: changedYears)
     {
-        logError(errorMessage);
+        _refCache->invalidate(yc);
     }
-    sqlite3_close(db);
-    return rc == SQLITE_OK;
+    return true;
 }
 
-bool ResearchScope::save(int idxComb, const int y)
+bool ResearchScope::saveMembers(int idxComb, const int y, const std::map<uint64_t, Publication> &pubsOfY, const std::set<uint64_t> &refIds, bool queried, const std::string &cursor)
 {
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(_path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + _path));
+    std::string combination = getCombination(idxComb);
+    int64_t combinationId = getCombinationId(combination, true);
+    if (combinationId == 0)
         return false;
+
+    for (auto &idToPub: pubsOfY)
+    {
+        if (!saveMember(WORK_SQL, combinationId, y, idToPub.first))
+            return false;
     }
-    CallbackData data;
-    char *errorMessage = NULL;
+    for (uint64_t refId: refIds)
+    {
+        if (!saveMember(REF_SQL, combinationId, y, refId))
+            return false;
+    }
+    if (!queried)
+        return cursor.empty() || saveCursor(combinationId, combination, y, cursor);
+    if (!saveCursor(combinationId, combination, y, ""))
+        return false;
 
-    std::string combination = getCombination(idxComb);
+    Statement stmt(prepare("INSERT OR IGNORE INTO openalex_queries(combination,year,update_time) VALUES (?,?,?);"));
+    if (!stmt.ok())
+        return false;
     time_t t;
     time(&t);
-    std::stringstream ss;
-    ss << "INSERT OR IGNORE INTO openalex_tokens(combination,year,update_time) VALUES ('"
-       << combination << "'," << y << "," << (int) t << ");";
-    logDebug(ss.str().c_str());
-    rc = sqlite3_exec(db, ss.str().c_str(), NULL, NULL, &errorMessage);
-    if (rc != SQLITE_OK)
+    stmt.bind(1, combination);
+    stmt.bind(2, y);
+    stmt.bind(3, (int)t);
+    if (!stmt.execute())
     {
-        logError(errorMessage);
+        logError(stmt.errorMessage());
+        return false;
     }
-    sqlite3_close(db);
-    return rc == SQLITE_OK;
+    return true;
 }
 
-bool ResearchScope::getMissingRefIds(int idxComb, const int y, std::vector<uint64_t> &newRefIds)
+// checkpoint the crawl of a combination in year y at the cursor, or drop its checkpoint if the cursor is empty
+bool ResearchScope::saveCursor(int64_t combinationId, const std::string &combination, const int y, const std::string &cursor)
 {
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(_path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + _path));
-        return false;
-    }
-    CallbackData data;
-    char *errorMessage = NULL;
-
-    // ---------------------------------------------------------------------------
-    // step 1: get ref ids of combination and year
+    if (cursor.empty())
     {
-        std::stringstream ss;
-        ss << "SELECT combination, year, ref_ids FROM openalex_queries"
-           " WHERE combination = '" << getCombination(idxComb) << "' AND year = " << y << ";";
-        logDebug(ss.str().c_str());
-        rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logDebug(errorMessage);
-        }
-        if (rc != SQLITE_OK || data.results.size() == 0)
+        Statement stmt(prepare("DELETE FROM openalex_cursors WHERE combination_id = ? AND year = ?;"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, combinationId);
+        stmt.bind(2, y);
+        if (!stmt.execute())
         {
-            sqlite3_close(db);
+            logError(stmt.errorMessage());
             return false;
         }
+        return true;
     }
-    std::string refIdsStr = data.results[0]["ref_ids"];
-    std::vector<std::string> refIDStrs = splitString(refIdsStr, ",");
-    std::vector<uint64_t> refIds;
-    for (std::string s : refIDStrs)
+
+    Statement stmt(prepare("INSERT OR REPLACE INTO openalex_cursors(combination_id,year,combination,cursor,num_works,update_time) "
+        "VALUES (?1,?2,?3,?4,(SELECT COUNT(*) FROM openalex_query_works WHERE combination_id = ?1 AND year = ?2),?5);"));
+    if (!stmt.ok())
+        return false;
+    time_t t;
+    time(&t);
+    stmt.bind(1, combinationId);
+    stmt.bind(2, y);
+    stmt.bind(3, combination);
+    stmt.bind(4, cursor);
+    stmt.bind(5, (int)t);
+    if (!stmt.execute())
     {
-        refIds.push_back(std::stoull(s));
+        logError(stmt.errorMessage());
+        return false;
     }
+    return true;
+}
 
-    // ---------------------------------------------------------------------------
-    // step 2: find old ids
+// the cursor an interrupted crawl of a combination in year y continues from, and the number of works it saved;
+// the checkpoint must name the combination too, since the id of a forgotten combination can be given to another
+bool ResearchScope::getCursor(int idxComb, const int y, std::string &cursor, int &numWorks)
+{
+    cursor = "";
+    numWorks = 0;
+    std::string combination = getCombination(idxComb);
+    int64_t combinationId = getCombinationId(combination);
+    if (combinationId == 0)
+        return false;
+
+    Statement stmt(prepare("SELECT cursor, num_works FROM openalex_cursors WHERE combination_id = ? AND year = ? AND combination = ?;"));
+    if (!stmt.ok())
+        return false;
+    stmt.bind(1, combinationId);
+    stmt.bind(2, y);
+    stmt.bind(3, combination);
+    if (!stmt.step())
     {
-        std::stringstream ss;
-        data.results.clear();
-        ss << "SELECT id FROM publications WHERE id IN (" << refIdsStr << ");";
-        logDebug(ss.str().c_str());
-        rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logDebug(errorMessage);
-        }
-        if (rc != SQLITE_OK || data.results.size() == 0)
-        {
-            sqlite3_close(db);
-            return false;
-        }
+        if (!stmt.done())
+            logDebug(stmt.errorMessage());
+        return false;
     }
-    std::set<uint64_t> oldRefIds;
-    for (auto result: data.results)
+    cursor = stmt.getString(0);
+    numWorks = stmt.getInt(1);
+    return !cursor.empty();
+}
+
+bool ResearchScope::save(int idxComb, const int y)
+{
+    Statement stmt(prepare("INSERT OR IGNORE INTO openalex_tokens(combination,year,update_time) VALUES (?,?,?);"));
+    if (!stmt.ok())
+        return false;
+
+    time_t t;
+    time(&t);
+    stmt.bind(1, getCombination(idxComb));
+    stmt.bind(2, y);
+    stmt.bind(3, (int)t);
+    if (!stmt.execute())
     {
-        oldRefIds.insert(std::stoull(result["id"]));
+        logError(stmt.errorMessage());
+        return false;
     }
+    return true;
+}
 
-    // ---------------------------------------------------------------------------
-    // step 3: output new ids
+bool ResearchScope::getMissingRefIds(int idxComb, const int y, std::vector<uint64_t> &newRefIds)
+{
     newRefIds.clear();
-    for (uint64_t id: refIds)
+    if (!queried(idxComb, y))
+        return false;
+
+    Statement stmt(prepare("SELECT r.ref_id FROM openalex_query_refs r"
+                           " JOIN openalex_combinations c ON c.id = r.combination_id"
+                           " WHERE c.combination = ? AND r.year = ?"
+                           " AND NOT EXISTS (SELECT 1 FROM publications p WHERE p.id = r.ref_id);"));
+    if (!stmt.ok())
+        return false;
+    stmt.bind(1, getCombination(idxComb));
+    stmt.bind(2, y);
+    while (stmt.step())
     {
-        if (oldRefIds.find(id) == oldRefIds.end())
-        {
-            newRefIds.push_back(id);
-        }
+        newRefIds.push_back(stmt.getUInt64(0));
+    }
+    if (!stmt.done())
+    {
+        logDebug(stmt.errorMessage());
+        return false;
     }
-    sqlite3_close(db);
     return true;
 }
 
-bool ResearchScope::getExistingRefIds(const int y, std::map<uint64_t, std::vector<uint64_t>> &refIdsOfId)
+bool ResearchScope::getExistingRefIds(const int y, std::shared_ptr<const RefIdsOfId> &refIdsOfId)
 {
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(_path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + _path));
+    uint64_t generation = 0;
+    refIdsOfId = _refCache->get(y, generation);
+    if (refIdsOfId)
+        return true;
+
+    if (!queried(y))
         return false;
-    }
-    char *errorMessage = NULL;
 
     int numCombs = numCombinations();
-    std::set<uint64_t> ids;
-    std::set<uint64_t> refIds;
+    std::shared_ptr<RefIdsOfId> myRefIdsOfId = std::make_shared<RefIdsOfId>();
 
     // ---------------------------------------------------------------------------
-    // step 1: get ids and ref ids of combination and year
+    // step 1: get works of combination and year
     for (int idxComb = 0; idxComb <numCombs; idxComb++)
     {
-        std::stringstream ss;
-        ss << "SELECT combination, year, ids, ref_ids FROM openalex_queries"
-           " WHERE combination = '" << getCombination(idxComb) << "' AND year = " << y << ";";
-        logDebug(ss.str().c_str());
-        CallbackData data;
-        rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logDebug(errorMessage);
-        }
-        if (rc != SQLITE_OK || data.results.size() == 0)
-        {
-            sqlite3_close(db);
+        Statement stmt(prepare("SELECT p.id FROM openalex_query_works w"
+                               " JOIN openalex_combinations c ON c.id = w.combination_id"
+                               " JOIN publications p ON p.id = w.work_id"
+                               " WHERE c.combination = ? AND w.year = ?;"));
+        if (!stmt.ok())
             return false;
-        }
-
-        std::string idsStr = data.results[0]["ids"];
-        std::vector<std::string> idStrs = splitString(idsStr, ",");
-        for (std::string s : idStrs)
+        stmt.bind(1, getCombination(idxComb));
+        stmt.bind(2, y);
+        while (stmt.step())
         {
-            ids.insert(std::stoull(s));
+            (*myRefIdsOfId)[stmt.getUInt64(0)];
         }
-
-        std::string refIdsStr = data.results[0]["ref_ids"];
-        std::vector<std::string> refIDStrs = splitString(refIdsStr, ",");
-        for (std::string s : refIDStrs)
+        if (!stmt.done())
         {
-            refIds.insert(std::stoull(s));
+            logDebug(stmt.errorMessage());
+            return false;
         }
     }
 
     // ---------------------------------------------------------------------------
-    // step 2: find existing ref ids
-    std::set<uint64_t> existingRefIds;
+    // step 2: get references of each work that are stored as publications
+    std::map<uint64_t, std::set<uint64_t>> refIdSetOfId;
+    for (int idxComb = 0; idxComb <numCombs; idxComb++)
     {
-        std::stringstream ss;
-        ss << "SELECT id FROM publications WHERE id IN (";
-        for (auto iter = refIds.begin(); iter != refIds.end(); iter++)
+        Statement stmt(prepare("SELECT ct.citing_id, ct.cited_id FROM openalex_query_works w"
+                               " JOIN openalex_combinations c ON c.id = w.combination_id"
+                               " JOIN citations ct ON ct.citing_id = w.work_id"
+                               " JOIN publications p ON p.id = ct.cited_id"
+                               " WHERE c.combination = ? AND w.year = ?;"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, getCombination(idxComb));
+        stmt.bind(2, y);
+        while (stmt.step())
         {
-            if (iter != refIds.begin())
-                ss << ",";
-            ss << *iter;
+            refIdSetOfId[stmt.getUInt64(0)].insert(stmt.getUInt64(1));
         }
-        ss << ");";
-        logDebug(ss.str().c_str());
-        CallbackData data;
-        rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
+        if (!stmt.done())
         {
-            logDebug(errorMessage);
-            sqlite3_close(db);
+            logDebug(stmt.errorMessage());
             return false;
         }
-
-        for (auto result: data.results)
-        {
-            existingRefIds.insert(std::stoull(result["id"]));
-        }
     }
-
-    // ---------------------------------------------------------------------------
-    // step 3: get ref_ids for each id
-    refIdsOfId.clear();
+    for (auto &idToRefIds: refIdSetOfId)
     {
-        std::stringstream ss;
-        ss << "SELECT id, ref_ids FROM publications WHERE id IN (";
-        for (auto iter = ids.begin(); iter != ids.end(); iter++)
-        {
-            if (iter != ids.begin())
-                ss << ",";
-            ss << *iter;
-        }
-        ss << ");";
-        logDebug(ss.str().c_str());
-        CallbackData data;
-        rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logDebug(errorMessage);
-            sqlite3_close(db);
-            return false;
-        }
-
-        for (auto result: data.results)
-        {
-            uint64_t id = std::stoull(result["id"]);
-            std::vector<uint64_t> myRefIds;
-            std::string refIdsStr = result["ref_ids"];
-            std::vector<std::string> refIDStrs = splitString(refIdsStr, ",");
-            for (std::string s : refIDStrs)
-            {
-                uint64_t refId = std::stoull(s);
-                if (existingRefIds.find(refId) != existingRefIds.end())
-                {
-                    myRefIds.push_back(refId);
-                }
-            }
-            refIdsOfId[id] = myRefIds;
-        }
+        (*myRefIdsOfId)[idToRefIds.first].assign(idToRefIds.second.begin(), idToRefIds.second.end());
     }
 
-    sqlite3_close(db);
+    // ---------------------------------------------------------------------------
+    // step 3: share the result with the other stages of the run
+    _refCache->put(y, myRefIdsOfId, generation);
+    refIdsOfId = myRefIdsOfId;
     return true;
 }
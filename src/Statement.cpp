@@ -0,0 +1,138 @@
+#include "Statement.h"
+
+Statement::Statement(sqlite3_stmt *stmt)
+{
+    //ctor
+    _stmt = stmt;
+    _rc = SQLITE_OK;
+}
+
+Statement::~Statement()
+{
+    //dtor
+    if (_stmt != NULL)
+    {
+        sqlite3_reset(_stmt);
+        sqlite3_clear_bindings(_stmt);
+    }
+}
+
+void Statement::bind(int i, int value)
+{
+    sqlite3_bind_int(_stmt, i, value);
+}
+
+void Statement::bind(int i, int64_t value)
+{
+    sqlite3_bind_int64(_stmt, i, (sqlite3_int64)value);
+}
+
+void Statement::bind(int i, uint64_t value)
+{
+    sqlite3_bind_int64(_stmt, i, (sqlite3_int64)value);
+}
+
+void Statement::bind(int i, double value)
+{
+    sqlite3_bind_double(_stmt, i, value);
+}
+
+void Statement::bind(int i, const std::string &value)
+{
+    sqlite3_bind_text(_stmt, i, value.c_str(), (int)value.size(), SQLITE_TRANSIENT);
+}
+
+void Statement::bindBlob(int i, const std::string &value)
+{
+    sqlite3_bind_blob(_stmt, i, value.data(), (int)value.size(), SQLITE_TRANSIENT);
+}
+
+// execute the statement until the next row, returning false when there are no more rows or on error
+bool Statement::step()
+{
+    _rc = sqlite3_step(_stmt);
+    return _rc == SQLITE_ROW;
+}
+
+// run a statement that returns no rows, then reset it so that it can be bound and run again
+bool Statement::execute()
+{
+    _rc = sqlite3_step(_stmt);
+    sqlite3_reset(_stmt);
+    return _rc == SQLITE_DONE;
+}
+
+// whether the last step ran the statement to completion without error
+bool Statement::done() const
+{
+    return _rc == SQLITE_DONE;
+}
+
+const char *Statement::errorMessage() const
+{
+    return sqlite3_errmsg(sqlite3_db_handle(_stmt));
+}
+
+int Statement::numColumns() const
+{
+    return sqlite3_column_count(_stmt);
+}
+
+const char *Statement::getColumnName(int col) const
+{
+    return sqlite3_column_name(_stmt, col);
+}
+
+bool Statement::isNull(int col) const
+{
+    return sqlite3_column_type(_stmt, col) == SQLITE_NULL;
+}
+
+bool Statement::isBlob(int col) const
+{
+    return sqlite3_column_type(_stmt, col) == SQLITE_BLOB;
+}
+
+int Statement::getInt(int col) const
+{
+    return sqlite3_column_int(_stmt, col);
+}
+
+int64_t Statement::getInt64(int col) const
+{
+    return (int64_t)sqlite3_column_int64(_stmt, col);
+}
+
+uint64_t Statement::getUInt64(int col) const
+{
+    return (uint64_t)sqlite3_column_int64(_stmt, col);
+}
+
+double Statement::getDouble(int col) const
+{
+    return sqlite3_column_double(_stmt, col);
+}
+
+std::string Statement::getString(int col) const
+{
+    const unsigned char *text = sqlite3_column_text(_stmt, col);
+    if (text == NULL)
+        return "";
+    return std::string((const char *)text, sqlite3_column_bytes(_stmt, col));
+}
+
+meta::util::string_view Statement::getText(int col) const
+{
+    const unsigned char *text = sqlite3_column_text(_stmt, col);
+    if (text == NULL)
+        return meta::util::string_view();
+    return meta::util::string_view((const char *)text, sqlite3_column_bytes(_stmt, col));
+}
+
+meta::util::string_view Statement::getBlob(int col) const
+{
+    const void *blob = sqlite3_column_blob(_stmt, col);
+    if (blob == NULL)
+        return meta::util::string_view();
+    return meta::util::string_view((const char *)blob, sqlite3_column_bytes(_stmt, col));
+}
@@ -1,5 +1,6 @@
 #include <StringProcessing.h>
 #include <algorithm>
+#include <cstdlib>
 #include <cstring>
 #include <regex>
 #include <map>
@@ -228,3 +229,45 @@ string getVectorStr(const vector<double> &v)
     }
     return ss.str();
 }
+
+// cut the next non-empty field off the front of text, without copying
+bool nextField(meta::util::string_view &text, char delimiter, meta::util::string_view &field)
+{
+    while (!text.empty())
+    {
+        size_t pos = text.find(delimiter);
+        field = text.substr(0, pos);
+        text.remove_prefix(pos == meta::util::string_view::npos ? text.size() : pos + 1);
+        if (!field.empty())
+            return true;
+    }
+    return false;
+}
+
+uint64_t toUInt64(meta::util::string_view text)
+{
+    uint64_t value = 0;
+    for (char c: text)
+    {
+        if (c < '0' || c > '9')
+            break;
+        value = value * 10 + (c - '0');
+    }
+    return value;
+}
+
+int toInt(meta::util::string_view text)
+{
+    if (!text.empty() && text[0] == '-')
+        return -(int)toUInt64(text.substr(1));
+    return (int)toUInt64(text);
+}
+
+double toDouble(meta::util::string_view text)
+{
+    char buffer[64];
+    size_t n = std::min(text.size(), sizeof(buffer) - 1);
+    memcpy(buffer, text.data(), n);
+    buffer[n] = '\0';
+    return atof(buffer);
+}
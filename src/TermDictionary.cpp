@@ -0,0 +1,202 @@
+#include "TermDictionary.h"
+#include <Statement.h>
+#include <Transaction.h>
+#include <wxFFileLog.h>
+
+std::mutex TermDictionary::_registryMutex;
+std::map<std::pair<std::string, std::string>, std::weak_ptr<TermDictionary>> TermDictionary::_registry;
+
+TermDictionary::TermDictionary(const std::string path, const std::string keywords)
+{
+    //ctor
+    _path = path;
+    _keywords = keywords;
+    _numSaved = 0;
+    load();
+}
+
+TermDictionary::~TermDictionary()
+{
+    //dtor
+}
+
+// read the terms numbered so far through a read-only handle, so that the GUI can translate ids too
+bool TermDictionary::load()
+{
+    std::shared_ptr<Database> db = Database::open(_path, true);
+    Statement stmt(db->prepare("SELECT id, stem, surface FROM scope_term_dict WHERE keywords = ? ORDER BY id;"));
+    if (!stmt.ok())
+        return true; // no stage has saved any term yet
+    stmt.bind(1, _keywords);
+    while (stmt.step())
+    {
+        uint32_t id = (uint32_t)stmt.getInt64(0);
+        if (id == 0)
+            continue;
+        if (_stems.size() < id)
+        {
+            _stems.resize(id);
+            _surfaces.resize(id);
+        }
+        _stems[id - 1] = stmt.getString(1);
+        _surfaces[id - 1] = stmt.getString(2);
+        _idOfStem[_stems[id - 1]] = id;
+    }
+    _numSaved = _stems.size();
+    if (!stmt.done())
+    {
+        logError(stmt.errorMessage());
+        return false;
+    }
+    return true;
+}
+
+// get the id of a term, numbering it if it is new
+uint32_t TermDictionary::getId(const std::string &stem, const std::string &surface)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto stemToId = _idOfStem.find(stem);
+    if (stemToId != _idOfStem.end())
+        return stemToId->second;
+    _stems.push_back(stem);
+    _surfaces.push_back(surface.empty() ? stem : surface);
+    uint32_t id = (uint32_t)_stems.size();
+    _idOfStem[stem] = id;
+    return id;
+}
+
+const std::string &TermDictionary::stem(uint32_t id)
+{
+    static const std::string noStem;
+    std::lock_guard<std::mutex> lock(_mutex);
+    return id > 0 && id <= _stems.size() ? _stems[id - 1] : noStem;
+}
+
+const std::string &TermDictionary::surface(uint32_t id)
+{
+    static const std::string noSurface;
+    std::lock_guard<std::mutex> lock(_mutex);
+    return id > 0 && id <= _surfaces.size() ? _surfaces[id - 1] : noSurface;
+}
+
+// get the biterm of a string "stem1&stem2"
+Biterm TermDictionary::getBiterm(const std::string &biterm)
+{
+    size_t pos = biterm.find('&');
+    if (pos == std::string::npos)
+        return 0;
+    return TermDictionary::biterm(getId(biterm.substr(0, pos)), getId(biterm.substr(pos + 1)));
+}
+
+// get the string of a biterm, with its stems in alphabetical order as older versions stored them
+std::string TermDictionary::getString(Biterm biterm)
+{
+    const std::string &stem1 = stem(first(biterm));
+    const std::string &stem2 = stem(second(biterm));
+    return stem1 < stem2 ? stem1 + "&" + stem2 : stem2 + "&" + stem1;
+}
+
+// write the terms numbered since the last save
+bool TermDictionary::save()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_numSaved == _stems.size())
+        return true;
+
+    std::shared_ptr<Database> db = Database::open(_path);
+    sqlite3 *handle = db->handle();
+    if (handle == NULL)
+        return false;
+
+    // step 1: create tables
+    const char*sqls[] =
+    {
+        "CREATE TABLE IF NOT EXISTS scope_term_dict("
+        "keywords TEXT,"
+        "id INTEGER,"
+        "stem TEXT,"
+        "surface TEXT,"
+        "PRIMARY KEY(keywords,id)) WITHOUT ROWID;",
+
+        "CREATE UNIQUE INDEX IF NOT EXISTS scope_term_dict_stem ON scope_term_dict(keywords,stem);",
+    };
+    for (const char*sql: sqls)
+    {
+        char *errorMessage = NULL;
+        logDebug(sql);
+        int rc = sqlite3_exec(handle, sql, NULL, NULL, &errorMessage);
+        if (rc != SQLITE_OK)
+        {
+            logError(errorMessage);
+            sqlite3_free(errorMessage);
+            return false;
+        }
+    }
+
+    // step 2: save the new terms
+    Transaction tx(handle);
+    if (!tx.ok())
+        return false;
+    Statement stmt(db->prepare("INSERT OR IGNORE INTO scope_term_dict(keywords, id, stem, surface) VALUES (?,?,?,?);"));
+    if (!stmt.ok())
+        return false;
+    for (size_t i = _numSaved; i < _stems.size(); i++)
+    {
+        stmt.bind(1, _keywords);
+        stmt.bind(2, (int64_t)(i + 1));
+        stmt.bind(3, _stems[i]);
+        stmt.bind(4, _surfaces[i]);
+        if (!stmt.execute())
+        {
+            logError(stmt.errorMessage());
+            return false;
+        }
+        if (!tx.step())
+            return false;
+    }
+
+    // step 3: count the terms saved only once they are committed, which a write-behind batch the
+    // transaction joined may still roll back
+    size_t numStems = _stems.size();
+    tx.onCommit([this, numStems]()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (numStems > _numSaved)
+                _numSaved = numStems;
+        });
+    lock.unlock();
+    return tx.commit();
+}
+
+// get the dictionary shared by all users of the same database and keywords, loading it if nobody holds it
+std::shared_ptr<TermDictionary> TermDictionary::open(const std::string path, const std::string keywords)
+{
+    std::lock_guard<std::mutex> lock(_registryMutex);
+    std::pair<std::string, std::string> key(path, keywords);
+    auto keyToDict = _registry.find(key);
+    if (keyToDict != _registry.end())
+    {
+        std::shared_ptr<TermDictionary> dict = keyToDict->second.lock();
+        if (dict)
+            return dict;
+    }
+    std::shared_ptr<TermDictionary> dict = std::make_shared<TermDictionary>(path, keywords);
+    _registry[key] = dict;
+    return dict;
+}
+
+// make the next save() of a dictionary still in use write every term again, after maintenance deleted the saved ones
+void TermDictionary::invalidate(const std::string path, const std::string keywords)
+{
+    std::shared_ptr<TermDictionary> dict;
+    {
+        std::lock_guard<std::mutex> lock(_registryMutex);
+        auto keyToDict = _registry.find(std::pair<std::string, std::string>(path, keywords));
+        if (keyToDict != _registry.end())
+            dict = keyToDict->second.lock();
+    }
+    if (!dict)
+        return;
+    std::lock_guard<std::mutex> lock(dict->_mutex);
+    dict->_numSaved = 0;
+}
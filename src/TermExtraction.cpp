@@ -2,7 +2,9 @@
 #include <../WESTSeerApp.h>
 #include <StringProcessing.h>
 #include <GeneralConfig.h>
-#include <CallbackData.h>
+#include <Transaction.h>
+#include <Blob.h>
+#include <IdSet.h>
 #include <wxFFileLog.h>
 #include <porter2_stemmer.h>
 #include <ctime>
@@ -52,139 +54,184 @@ void TermExtraction::doStep(int stepId)
     process(_y0 + stepId);
 }
 
-// Load title, abstract, and reference titles of the works in the scope and published in year y
-bool TermExtraction::load(int y, std::map<uint64_t, std::vector<std::string>> &texts)
+bool TermExtraction::flush()
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
+    return _scope.flush();
+}
 
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + path));
-        return false;
-    }
-    CallbackData data;
-    char *errorMessage = NULL;
+static const int TITLE = 0;
+static const int ABSTRACT = 1;
 
-    // step 1: get ids and reference ids
+// Load the tokens of title, abstract, and reference titles of the works in the scope and published in year y
+bool TermExtraction::load(int y, std::map<uint64_t, std::vector<std::shared_ptr<const TokenizedText>>> &texts)
+{
+    // step 1: load titles, abstracts and refIds of the works
     std::set<uint64_t> ids;
-    std::set<uint64_t> refIds;
+    std::map<uint64_t, std::string> titles;
+    std::map<uint64_t, std::string> abstracts;
+    std::map<uint64_t, std::set<uint64_t>> workRefIds;
     int nCombs = _scope.numCombinations();
     for (int idxComb = 0; idxComb < nCombs; idxComb++)
     {
-        data.results.clear();
-        std::stringstream ss;
-        ss << "SELECT combination, year, ids, ref_ids FROM openalex_queries"
-           " WHERE combination = '" << _scope.getCombination(idxComb) << "' AND year = " << y << ";";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
+        if (!_scope.queried(idxComb, y))
+            return false;
+
+        Statement stmt(_scope.prepare("SELECT p.id, p.title, p.abstract, p.ref_ids FROM openalex_query_works w"
+                                      " JOIN openalex_combinations c ON c.id = w.combination_id"
+                                      " JOIN publications p ON p.id = w.work_id"
+                                      " WHERE c.combination = ? AND w.year = ?;"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, _scope.getCombination(idxComb));
+        stmt.bind(2, y);
+        while (stmt.step())
         {
-            logDebug(errorMessage);
+            uint64_t id = stmt.getUInt64(0);
+            if (!ids.insert(id).second)
+                continue;
+            titles[id] = stmt.getString(1);
+            abstracts[id] = stmt.getString(2);
+            std::set<uint64_t> &myRefIds = workRefIds[id];
+            meta::util::string_view text = stmt.getText(3);
+            meta::util::string_view field;
+            while (nextField(text, ',', field))
+            {
+                myRefIds.insert(toUInt64(field));
+            }
         }
-        if (rc != SQLITE_OK || data.results.size() == 0)
+        if (!stmt.done())
         {
-            sqlite3_close(db);
+            logDebug(stmt.errorMessage());
             return false;
         }
-        std::vector<std::string> idStrs = splitString(data.results[0]["ids"], ",");
-        std::vector<std::string> refIdStrs = splitString(data.results[0]["ref_ids"], ",");
-        for (std::string idStr: idStrs)
+    }
+
+    // step 2: load reference titles
+    std::map<uint64_t, std::string> refTitles;
+    for (int idxComb = 0; idxComb < nCombs; idxComb++)
+    {
+        Statement stmt(_scope.prepare("SELECT p.id, p.title FROM openalex_query_refs r"
+                                      " JOIN openalex_combinations c ON c.id = r.combination_id"
+                                      " JOIN publications p ON p.id = r.ref_id"
+                                      " WHERE c.combination = ? AND r.year = ? AND p.language = 'en';"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, _scope.getCombination(idxComb));
+        stmt.bind(2, y);
+        while (stmt.step())
         {
-            ids.insert(std::stoull(idStr));
+            uint64_t refId = stmt.getUInt64(0);
+            if (refTitles.find(refId) == refTitles.end())
+                refTitles[refId] = stmt.getString(1);
         }
-        for (std::string refIdStr: refIdStrs)
+        if (!stmt.done())
         {
-            refIds.insert(std::stoull(refIdStr));
+            logDebug(stmt.errorMessage());
+            return false;
         }
     }
 
-    // step 2: load titles, abstracts and refIds of ids
-    data.results.clear();
-    std::map<uint64_t, std::string> titles;
-    std::map<uint64_t, std::string> abstracts;
-    std::map<uint64_t, std::set<uint64_t>> workRefIds;
+    // step 3: get the tokens of the titles and abstracts, tokenizing those that are not cached yet
+    std::map<std::pair<uint64_t, int>, std::shared_ptr<const TokenizedText>> tokens;
+    std::map<std::pair<uint64_t, int>, const std::string *> untokenized;
+    std::set<uint64_t> refIds;
+    for (auto &refIdToRefTitle: refTitles)
     {
-        std::stringstream ss;
-        ss << "SELECT id, title, abstract, ref_ids FROM publications WHERE id in (";
-        for (auto iter = ids.begin(); iter != ids.end(); iter++)
+        refIds.insert(refIdToRefTitle.first);
+    }
+    if (!loadTokens(ids, ABSTRACT, tokens) || !loadTokens(refIds, TITLE, tokens))
+        return false;
+    for (auto &idToTitle: titles)
+    {
+        std::pair<uint64_t, int> field(idToTitle.first, TITLE);
+        if (tokens.find(field) == tokens.end())
         {
-            if (iter != ids.begin())
-                ss << ",";
-            ss << *iter;
+            tokens[field];
+            untokenized[field] = &idToTitle.second;
         }
-        ss << ");";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
+    }
+    for (auto &idToAbstract: abstracts)
+    {
+        std::pair<uint64_t, int> field(idToAbstract.first, ABSTRACT);
+        if (tokens.find(field) == tokens.end())
         {
-            logDebug(errorMessage);
-            sqlite3_close(db);
-            return false;
+            tokens[field];
+            untokenized[field] = &idToAbstract.second;
         }
-        for (auto &result: data.results)
+    }
+    for (auto &refIdToRefTitle: refTitles)
+    {
+        std::pair<uint64_t, int> field(refIdToRefTitle.first, TITLE);
+        if (tokens.find(field) == tokens.end())
         {
-            uint64_t id = std::stoull(result["id"]);
-            titles[id] = result["title"];
-            abstracts[id] = result["abstract"];
-            std::set<uint64_t> myRefIds;
-            std::vector<std::string> myRefIdStrs = splitString(result["ref_ids"], ",");
-            for (std::string refIdStr: myRefIdStrs)
-            {
-                myRefIds.insert(std::stoull(refIdStr));
-            }
-            workRefIds[id] = myRefIds;
+            tokens[field];
+            untokenized[field] = &refIdToRefTitle.second;
         }
     }
-
-    // step 3: load reference titles
-    data.results.clear();
-    std::map<uint64_t, std::string> refTitles;
+    if (untokenized.size() > 0)
     {
-        std::stringstream ss;
-        ss << "SELECT id, title FROM publications WHERE language = 'en' AND id in (";
-        for (auto iter = refIds.begin(); iter != refIds.end(); iter++)
+        std::queue<std::pair<uint64_t, int>> q;
+        for (auto &fieldToText: untokenized)
         {
-            if (iter != refIds.begin())
-                ss << ",";
-            ss << *iter;
+            q.push(fieldToText.first);
         }
-        ss << ");";
-        logDebug(ss.str().c_str());
-        rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
+        std::mutex mq;
+        int nThreads = std::thread::hardware_concurrency();
+        std::thread *threads[nThreads];
+        for (int tid = 0; tid < nThreads; tid++)
         {
-            logDebug(errorMessage);
-            sqlite3_close(db);
-            return false;
+            threads[tid] = new std::thread([&q, &mq, &untokenized, &tokens, this]
+                {
+                    for (;;)
+                    {
+                        std::pair<uint64_t, int> field;
+                        {
+                            std::lock_guard<std::mutex> lock(mq);
+                            if (q.empty())
+                                return;
+                            field = q.front();
+                            q.pop();
+                        }
+                        // the entry exists already, so assigning it does not change the map
+                        tokens.find(field)->second = tokenizeText(*untokenized.find(field)->second);
+                        if (_cancelled.load() == true)
+                            return;
+                    }
+                });
         }
-        for (auto &result: data.results)
+        for (int tid = 0; tid < nThreads; tid++)
         {
-            uint64_t refId = std::stoull(result["id"]);
-            refTitles[refId] = result["title"];
+            threads[tid]->join();
+            delete threads[tid];
         }
+        if (_cancelled.load() == true)
+            return false;
+
+        std::map<std::pair<uint64_t, int>, std::shared_ptr<const TokenizedText>> newTokens;
+        for (auto &fieldToText: untokenized)
+        {
+            newTokens[fieldToText.first] = tokens[fieldToText.first];
+        }
+        saveTokens(newTokens);
     }
 
     // step 4: merge texts
+    std::shared_ptr<const TokenizedText> noText = std::make_shared<TokenizedText>();
     texts.clear();
     for (uint64_t id: ids)
     {
-        auto idToTitle = titles.find(id);
-        if (idToTitle == titles.end())
+        auto idToTitle = tokens.find(std::pair<uint64_t, int>(id, TITLE));
+        if (idToTitle == tokens.end())
             continue;
 
-        std::vector<std::string> text;
-        text.push_back(normalize(idToTitle->second));
+        std::vector<std::shared_ptr<const TokenizedText>> text;
+        text.push_back(idToTitle->second);
 
-        auto idToAbstract = abstracts.find(id);
-        if (idToAbstract == abstracts.end())
-            text.push_back("");
+        auto idToAbstract = tokens.find(std::pair<uint64_t, int>(id, ABSTRACT));
+        if (idToAbstract == tokens.end())
+            text.push_back(noText);
         else
-            text.push_back(normalize(idToAbstract->second));
+            text.push_back(idToAbstract->second);
 
         auto idToRefIds = workRefIds.find(id);
         if (idToRefIds == workRefIds.end())
@@ -195,30 +242,172 @@ bool TermExtraction::load(int y, std::map<uint64_t, std::vector<std::string>> &t
 
         for (uint64_t refId: idToRefIds->second)
         {
-            auto refIdToRefTitle = refTitles.find(refId);
-            if (refIdToRefTitle != refTitles.end())
+            if (refTitles.find(refId) == refTitles.end())
+                continue;
+            auto refIdToRefTitle = tokens.find(std::pair<uint64_t, int>(refId, TITLE));
+            if (refIdToRefTitle != tokens.end())
             {
-                text.push_back(normalize(refIdToRefTitle->second));
+                text.push_back(refIdToRefTitle->second);
             }
         }
         texts[id] = text;
     }
-    sqlite3_close(db);
     return true;
 }
 
-bool TermExtraction::save(int y, const std::map<uint64_t, std::map<std::string, std::pair<std::string, int>>> &termFreqs)
+// normalize a text, split it into terms and stem their tokens
+std::shared_ptr<const TokenizedText> TermExtraction::tokenizeText(const std::string &text)
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
+    std::shared_ptr<TokenizedText> tokens = std::make_shared<TokenizedText>();
+    tokens->terms = split(normalize(text));
+    tokens->stems.resize(tokens->terms.size());
+    for (size_t idxTerm = 0; idxTerm < tokens->terms.size(); idxTerm++)
+    {
+        std::vector<std::string> &stems = tokens->stems[idxTerm];
+        stems = tokens->terms[idxTerm];
+        for (std::string &stem: stems)
+        {
+            Porter2Stemmer::stem(stem);
+        }
+    }
+    return tokens;
+}
 
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
+// get the cached tokens of the fields up to maxField of the publications, joining pub_tokens against the ids
+bool TermExtraction::loadTokens(const std::set<uint64_t> &ids, int maxField, std::map<std::pair<uint64_t, int>, std::shared_ptr<const TokenizedText>> &texts)
+{
+    IdSet idSet(_scope.database(), "token_ids");
+    if (!idSet.insert(ids))
+        return false;
+    Statement stmt(_scope.prepare("SELECT t.id, t.field, t.tokens FROM temp.token_ids s"
+                                  " JOIN pub_tokens t ON t.id = s.id"
+                                  " WHERE t.field <= ?;"));
+    if (!stmt.ok())
+        return false;
+    stmt.bind(1, maxField);
+    while (stmt.step())
     {
-        logError(wxT("Cannot open database at" + path));
+        std::pair<uint64_t, int> field(stmt.getUInt64(0), stmt.getInt(1));
+        if (texts.find(field) != texts.end())
+            continue;
+        std::shared_ptr<const TokenizedText> text;
+        if (decodeTokens(stmt.getBlob(2), text))
+            texts[field] = text;
+    }
+    if (!stmt.done())
+    {
+        logDebug("%s", stmt.errorMessage());
         return false;
     }
+    return true;
+}
+
+// decode the number of terms, then the number of tokens of each term followed by each token and
+// its stem, which is left empty when it equals the token
+bool TermExtraction::decodeTokens(meta::util::string_view bytes, std::shared_ptr<const TokenizedText> &text)
+{
+    std::shared_ptr<TokenizedText> tokens = std::make_shared<TokenizedText>();
+    BlobReader blob(bytes);
+    uint64_t numTerms = blob.readVarint();
+    for (uint64_t i = 0; i < numTerms && blob.ok(); i++)
+    {
+        uint64_t numTokens = blob.readVarint();
+        tokens->terms.push_back(std::vector<std::string>());
+        tokens->stems.push_back(std::vector<std::string>());
+        std::vector<std::string> &term = tokens->terms.back();
+        std::vector<std::string> &stems = tokens->stems.back();
+        for (uint64_t j = 0; j < numTokens && blob.ok(); j++)
+        {
+            term.push_back(blob.readString().to_string());
+            meta::util::string_view stem = blob.readString();
+            stems.push_back(stem.empty() ? term.back() : stem.to_string());
+        }
+    }
+    if (!blob.ok() || !blob.atEnd())
+    {
+        logError("Corrupted tokens in pub_tokens.");
+        return false;
+    }
+    text = tokens;
+    return true;
+}
+
+bool TermExtraction::saveTokens(const std::map<std::pair<uint64_t, int>, std::shared_ptr<const TokenizedText>> &texts)
+{
+    sqlite3 *db = _scope.db();
+    if (db == NULL)
+        return false;
+    Transaction tx(db);
+    if (!tx.ok())
+        return false;
+    Statement stmt(_scope.prepare("INSERT OR REPLACE INTO pub_tokens(id, field, tokens) VALUES (?,?,?);"));
+    if (!stmt.ok())
+        return false;
+    for (auto &fieldToText: texts)
+    {
+        const TokenizedText &text = *fieldToText.second;
+        BlobWriter blob;
+        blob.writeVarint(text.terms.size());
+        for (size_t idxTerm = 0; idxTerm < text.terms.size(); idxTerm++)
+        {
+            const std::vector<std::string> &term = text.terms[idxTerm];
+            const std::vector<std::string> &stems = text.stems[idxTerm];
+            blob.writeVarint(term.size());
+            for (size_t i = 0; i < term.size(); i++)
+            {
+                blob.writeString(term[i]);
+                blob.writeString(stems[i] == term[i] ? std::string() : stems[i]);
+            }
+        }
+        stmt.bind(1, fieldToText.first.first);
+        stmt.bind(2, fieldToText.first.second);
+        stmt.bindBlob(3, blob.bytes());
+        if (!stmt.execute())
+        {
+            logError(stmt.errorMessage());
+            return false;
+        }
+        if (!tx.step())
+            return false;
+    }
+    return tx.commit();
+}
+
+// encode the term frequencies of a work as their number followed by the stem, term and frequency of each
+static std::string encodeTermFreqs(const std::map<std::string, std::pair<std::string,int>> &termFreqs)
+{
+    BlobWriter blob;
+    blob.writeVarint(termFreqs.size());
+    for (auto termToFreq = termFreqs.begin(); termToFreq != termFreqs.end(); termToFreq++)
+    {
+        blob.writeString(termToFreq->first);
+        blob.writeString(termToFreq->second.first);
+        blob.writeVarint(termToFreq->second.second);
+    }
+    return blob.bytes();
+}
+
+static bool decodeTermFreqs(meta::util::string_view bytes, std::map<std::string, std::pair<std::string,int>> &termFreqs)
+{
+    BlobReader blob(bytes);
+    uint64_t n = blob.readVarint();
+    for (uint64_t i = 0; i < n && blob.ok(); i++)
+    {
+        meta::util::string_view stem = blob.readString();
+        meta::util::string_view term = blob.readString();
+        int freq = (int)blob.readVarint();
+        if (blob.ok())
+            termFreqs[stem.to_string()] = std::pair<std::string,int>(term.to_string(), freq);
+    }
+    return blob.ok() && blob.atEnd();
+}
+
+bool TermExtraction::save(int y, const std::map<uint64_t, std::map<std::string, std::pair<std::string, int>>> &termFreqs, const std::string &terms)
+{
+    sqlite3 *db = _scope.partitionDb();
+    if (db == NULL)
+        return false;
+    int rc = SQLITE_OK;
     char *errorMessage = NULL;
 
     // step 1: create tables
@@ -246,151 +435,148 @@ bool TermExtraction::save(int y, const std::map<uint64_t, std::map<std::string,
         if (rc != SQLITE_OK)
         {
             logError(errorMessage);
-            sqlite3_close(db);
             return false;
         }
     }
 
-    // step 2: save publication scope terms
+    // step 2: number the terms, so that later stages can refer to them by id
+    std::shared_ptr<TermDictionary> dict = _scope.dictionary();
+    for (auto iter = termFreqs.begin(); iter != termFreqs.end(); iter++)
+    {
+        for (auto termToFreq = iter->second.begin(); termToFreq != iter->second.end(); termToFreq++)
+        {
+            dict->getId(termToFreq->first, termToFreq->second.first);
+        }
+    }
+    if (!dict->save())
+        return false;
+
+    // step 3: save publication scope terms
+    Transaction tx(db);
+    if (!tx.ok())
+        return false;
     std::string keywords = _scope.getKeywords();
     time_t t;
     time(&t);
-    if (termFreqs.size() > 0)
     {
-        std::stringstream ss;
-        ss << "INSERT OR IGNORE INTO pub_scope_terms(id, scope_keywords, year, update_time, terms) VALUES ";
+        Statement stmt(_scope.preparePartition("INSERT OR IGNORE INTO pub_scope_terms(id, scope_keywords, year, update_time, terms) VALUES (?,?,?,?,?);"));
+        if (!stmt.ok())
+            return false;
         for (auto iter = termFreqs.begin(); iter != termFreqs.end(); iter++)
         {
-            if (iter != termFreqs.begin())
-                ss << ",";
-            ss << "(" << iter->first << ",'" << keywords << "'," << y << "," << (int)t << ",'";
-            for (auto termToFreq = iter->second.begin(); termToFreq != iter->second.end(); termToFreq++)
+            stmt.bind(1, iter->first);
+            stmt.bind(2, keywords);
+            stmt.bind(3, y);
+            stmt.bind(4, (int)t);
+            stmt.bindBlob(5, encodeTermFreqs(iter->second));
+            if (!stmt.execute())
             {
-                if (termToFreq != iter->second.begin())
-                    ss << ",";
-                ss << termToFreq->first << ":" << termToFreq->second.first << ":" << termToFreq->second.second;
+                logError(stmt.errorMessage());
+                return false;
             }
-            ss << "')";
-        }
-        ss << ";";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), NULL, NULL, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logError(errorMessage);
-            sqlite3_close(db);
-            return false;
+            if (!tx.step())
+                return false;
         }
     }
 
-    // step 3: save scope terms
+    // step 4: save scope terms
     {
-        std::stringstream ss;
-        std::string terms = _matcher.getTerms();
-        ss << "INSERT OR IGNORE INTO scope_terms(keywords, year, update_time, terms) VALUES ('"
-            << keywords << "'," << y << "," << (int)t <<",'" << terms << "');";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), NULL, NULL, &errorMessage);
-        if (rc != SQLITE_OK)
+        Statement stmt(_scope.preparePartition("INSERT OR IGNORE INTO scope_terms(keywords, year, update_time, terms) VALUES (?,?,?,?);"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        stmt.bind(3, (int)t);
+        stmt.bind(4, terms);
+        if (!stmt.execute())
         {
-            logError(errorMessage);
-            sqlite3_close(db);
+            logError(stmt.errorMessage());
             return false;
         }
     }
-    sqlite3_close(db);
-    return true;
+    return tx.commit();
 }
 
 bool TermExtraction::load(int y, std::map<uint64_t, std::map<std::string, std::pair<std::string, int>>> *termFreqs, bool loadTerms)
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
-
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + path));
-        return false;
-    }
-    CallbackData data;
-    char *errorMessage = NULL;
-
     // step 1: load publication scope terms
     std::string keywords = _scope.getKeywords();
     if (termFreqs != NULL)
     {
         termFreqs->clear();
         {
-            std::stringstream ss;
-            ss << "SELECT id, scope_keywords, year, terms FROM pub_scope_terms WHERE scope_keywords = '"
-                << keywords << "' AND year = " << y << ";";
-            logDebug(ss.str().c_str());
-            rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-            if (rc != SQLITE_OK)
-            {
-                logDebug(errorMessage);
-                sqlite3_close(db);
+            Statement stmt(_scope.preparePartition("SELECT id, terms FROM pub_scope_terms WHERE scope_keywords = ? AND year = ?;"));
+            if (!stmt.ok())
                 return false;
-            }
-            for (auto &result: data.results)
+            stmt.bind(1, keywords);
+            stmt.bind(2, y);
+            while (stmt.step())
             {
-                std::map<std::string, std::pair<std::string,int>> myTermFreqs;
-                uint64_t id = std::stoull(result["id"]);
-                std::string strTermFreqs = result["terms"];
-                std::vector<std::string> fields = splitString(strTermFreqs, ",");
-                for (std::string field: fields)
+                uint64_t id = stmt.getUInt64(0);
+                std::map<std::string, std::pair<std::string,int>> &myTermFreqs = (*termFreqs)[id];
+                if (stmt.isBlob(1))
+                {
+                    if (!decodeTermFreqs(stmt.getBlob(1), myTermFreqs))
+                    {
+                        logError("Corrupted terms in pub_scope_terms.");
+                        return false;
+                    }
+                    continue;
+                }
+
+                // rows written by older versions are text
+                meta::util::string_view text = stmt.getText(1);
+                meta::util::string_view field, stem, term, freq;
+                while (nextField(text, ',', field))
                 {
-                    std::vector<std::string> kv = splitString(field, ":");
-                    std::pair<std::string,int> tf(kv[1],atoi(kv[2].c_str()));
-                    myTermFreqs[kv[0]] = tf;
+                    nextField(field, ':', stem);
+                    nextField(field, ':', term);
+                    nextField(field, ':', freq);
+                    std::pair<std::string,int> tf(term.to_string(), toInt(freq));
+                    myTermFreqs[stem.to_string()] = tf;
                 }
-                (*termFreqs)[id] = myTermFreqs;
+            }
+            if (!stmt.done())
+            {
+                logDebug(stmt.errorMessage());
+                return false;
             }
         }
     }
 
 
     // step 2: load scope terms
-    data.results.clear();
     if (loadTerms)
     {
-        std::stringstream ss;
-        ss << "SELECT keywords, year, terms FROM scope_terms WHERE keywords = '"
-            << keywords << "' AND year = " << y << ";";
-        logDebug(ss.str().c_str());
-        rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logDebug(errorMessage);
-            sqlite3_close(db);
+        Statement stmt(_scope.preparePartition("SELECT terms FROM scope_terms WHERE keywords = ? AND year = ?;"));
+        if (!stmt.ok())
             return false;
-        }
-        if (data.results.size() > 0)
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        if (!stmt.step())
         {
-            std::string terms = data.results[0]["terms"];
-            _matcher.load(terms);
+            if (!stmt.done())
+                logDebug(stmt.errorMessage());
+            return false;
         }
+        std::string terms = stmt.getString(0);
+        _matcher.load(terms);
     }
     else
     {
-        std::stringstream ss;
-        ss << "SELECT keywords, year FROM scope_terms WHERE keywords = '"
-            << keywords << "' AND year = " << y << ";";
-        logDebug(ss.str().c_str());
-        rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
+        Statement stmt(_scope.preparePartition("SELECT year FROM scope_terms WHERE keywords = ? AND year = ?;"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        if (!stmt.step())
         {
-            logDebug(errorMessage);
-            sqlite3_close(db);
+            if (!stmt.done())
+                logDebug(stmt.errorMessage());
             return false;
         }
     }
-    sqlite3_close(db);
-    return (data.results.size() > 0);
+    return true;
 }
 
 // seperate text with puntuations and stop words, unless "-" forces connecting tokens into one term
@@ -443,7 +629,7 @@ bool TermExtraction::process(int y)
         return true;
 
     // step 1:load texts
-    std::map<uint64_t, std::vector<std::string>> texts;
+    std::map<uint64_t, std::vector<std::shared_ptr<const TokenizedText>>> texts;
     if (!load(y, texts))
         return false;
     if (_cancelled.load() == true)
@@ -454,14 +640,13 @@ bool TermExtraction::process(int y)
     // step 2: extract terms
     for (auto iter = texts.begin(); iter != texts.end(); iter++)
     {
-        std::vector<std::string> &texts = iter->second;
+        std::vector<std::shared_ptr<const TokenizedText>> &texts = iter->second;
         for (size_t idxText = 0; idxText < 2 && idxText < texts.size(); idxText++)
         {
-            std::vector<std::vector<std::string>> terms = split(texts[idxText]);
+            const std::vector<std::vector<std::string>> &terms = texts[idxText]->terms;
             for (size_t idxTerm = 0; idxTerm < terms.size(); idxTerm++)
             {
-                std::vector<std::string> &term = terms[idxTerm];
-                _matcher.insertTerm(term, 0);
+                _matcher.insertTerm(terms[idxTerm], 0);
             }
         }
         if (_cancelled.load() == true)
@@ -500,14 +685,15 @@ bool TermExtraction::process(int y)
                     }
 
                     auto iter = texts.find(id);
-                    std::vector<std::string> &texts = iter->second;
+                    std::vector<std::shared_ptr<const TokenizedText>> &texts = iter->second;
                     std::map<std::string, std::map<std::string,int>> termFreqsOfWork;
                     for (size_t idxText = 0; idxText < texts.size(); idxText++)
                     {
-                        std::vector<std::vector<std::string>> terms = split(texts[idxText]);
+                        const std::vector<std::vector<std::string>> &terms = texts[idxText]->terms;
                         for (size_t idxTerm = 0; idxTerm < terms.size(); idxTerm++)
                         {
-                            std::vector<std::string> &term = terms[idxTerm];
+                            const std::vector<std::string> &term = terms[idxTerm];
+                            const std::vector<std::string> &stems = texts[idxText]->stems[idxTerm];
                             for (size_t i = 0; i < term.size(); i++)
                             {
                                 std::vector<AbstractMatcher::Type> m = _matcher.match(term, i);
@@ -520,10 +706,8 @@ bool TermExtraction::process(int y)
                                         s += " ";
                                         t += " ";
                                     }
-                                    std::string token = term[i + j];
-                                    t += token;
-                                    Porter2Stemmer::stem(token);
-                                    s += token;
+                                    t += term[i + j];
+                                    s += stems[i + j];
                                     if (m[j] == AbstractMatcher::TERM)
                                     {
                                         auto sToTFreq = termFreqsOfWork.find(s);
@@ -587,8 +771,14 @@ bool TermExtraction::process(int y)
 
     if (termFreqs.size() < texts.size())
         return false;
-    // step 4: save extraction results
-    save(y, termFreqs);
+    // step 4: save extraction results while the next year is extracted
+    auto results = std::make_shared<std::map<uint64_t, std::map<std::string, std::pair<std::string, int>>>>();
+    results->swap(termFreqs);
+    std::string terms = _matcher.getTerms();
+    _scope.saveLater([this, y, results, terms]()
+        {
+            return save(y, *results, terms);
+        });
     if (y == _y2 - 1)
     {
         _matcher.clear();
@@ -1,7 +1,8 @@
 #include "TermTfIrdf.h"
 #include <../WESTSeerApp.h>
 #include <GeneralConfig.h>
-#include <CallbackData.h>
+#include <Transaction.h>
+#include <Blob.h>
 #include <wxFFileLog.h>
 #include <StringProcessing.h>
 #include <ctime>
@@ -53,18 +54,44 @@ void TermTfIrdf::doStep(int stepId)
     process(_y0 + stepId);
 }
 
-bool TermTfIrdf::save(int y, const std::map<uint64_t, std::map<std::string, double>> &tfirdfs)
+bool TermTfIrdf::flush()
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
+    return _scope.flush();
+}
 
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
+// encode the tfirdfs of a publication as their number followed by each term id and tfirdf
+static std::string encodeTfirdfs(const std::map<uint32_t, double> &tfirdfs)
+{
+    BlobWriter blob(2);
+    blob.writeVarint(tfirdfs.size());
+    for (auto termToTfirdf = tfirdfs.begin(); termToTfirdf != tfirdfs.end(); termToTfirdf++)
     {
-        logError(wxT("Cannot open database at" + path));
-        return false;
+        blob.writeVarint(termToTfirdf->first);
+        blob.writeDouble(termToTfirdf->second);
+    }
+    return blob.bytes();
+}
+
+static bool decodeTfirdfs(meta::util::string_view bytes, std::map<uint32_t, double> &tfirdfs)
+{
+    BlobReader blob(bytes, 2);
+    uint64_t n = blob.readVarint();
+    for (uint64_t i = 0; i < n && blob.ok(); i++)
+    {
+        uint32_t term = (uint32_t)blob.readVarint();
+        double tfirdf = blob.readDouble();
+        if (blob.ok())
+            tfirdfs[term] = tfirdf;
     }
+    return blob.ok() && blob.atEnd();
+}
+
+bool TermTfIrdf::save(int y, const std::map<uint64_t, std::map<uint32_t, double>> &tfirdfs, const std::map<std::string, int> &dfs, int numWorks)
+{
+    sqlite3 *db = _scope.partitionDb();
+    if (db == NULL)
+        return false;
+    int rc = SQLITE_OK;
     char *errorMessage = NULL;
 
     // step 1: create tables
@@ -93,163 +120,163 @@ bool TermTfIrdf::save(int y, const std::map<uint64_t, std::map<std::string, doub
         if (rc != SQLITE_OK)
         {
             logError(errorMessage);
-            sqlite3_close(db);
             return false;
         }
     }
 
     // step 2: save publication scope tfirdfs
+    if (!_scope.dictionary()->save())
+        return false;
+    Transaction tx(db);
+    if (!tx.ok())
+        return false;
     std::string keywords = _scope.getKeywords();
     time_t t;
     time(&t);
-    if (tfirdfs.size() > 0)
     {
-        std::stringstream ss;
-        ss << "INSERT OR IGNORE INTO pub_scope_tfirdfs(id, scope_keywords, year, update_time, tfirdfs) VALUES ";
+        Statement stmt(_scope.preparePartition("INSERT OR IGNORE INTO pub_scope_tfirdfs(id, scope_keywords, year, update_time, tfirdfs) VALUES (?,?,?,?,?);"));
+        if (!stmt.ok())
+            return false;
         for (auto iter = tfirdfs.begin(); iter != tfirdfs.end(); iter++)
         {
-            if (iter != tfirdfs.begin())
-                ss << ",";
-            ss << "(" << iter->first << ",'" << keywords << "'," << y << "," << (int)t << ",'";
-            for (auto termToTfirdfs = iter->second.begin(); termToTfirdfs != iter->second.end(); termToTfirdfs++)
+            stmt.bind(1, iter->first);
+            stmt.bind(2, keywords);
+            stmt.bind(3, y);
+            stmt.bind(4, (int)t);
+            stmt.bindBlob(5, encodeTfirdfs(iter->second));
+            if (!stmt.execute())
             {
-                if (termToTfirdfs != iter->second.begin())
-                    ss << ",";
-                ss << termToTfirdfs->first << ":" << termToTfirdfs->second;
+                logError(stmt.errorMessage());
+                return false;
             }
-            ss << "')";
-        }
-        ss << ";";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), NULL, NULL, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logError(errorMessage);
-            sqlite3_close(db);
-            return false;
+            if (!tx.step())
+                return false;
         }
     }
 
     // step 3: save scope dfs
     {
         std::stringstream ss;
-        ss << "INSERT OR IGNORE INTO scope_dfs(keywords, year, update_time, num_works, dfs) VALUES ('"
-            << keywords << "'," << y << "," << (int)t << "," << _numWorks <<",'";
-        for (auto iter = _dfs.begin(); iter != _dfs.end(); iter++)
+        for (auto iter = dfs.begin(); iter != dfs.end(); iter++)
         {
-            if (iter != _dfs.begin())
+            if (iter != dfs.begin())
                 ss << ",";
             ss << iter->first << ":" << iter->second;
         }
-        ss << "');";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), NULL, NULL, &errorMessage);
-        if (rc != SQLITE_OK)
+        Statement stmt(_scope.preparePartition("INSERT OR IGNORE INTO scope_dfs(keywords, year, update_time, num_works, dfs) VALUES (?,?,?,?,?);"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        stmt.bind(3, (int)t);
+        stmt.bind(4, numWorks);
+        stmt.bind(5, ss.str());
+        if (!stmt.execute())
         {
-            logError(errorMessage);
-            sqlite3_close(db);
+            logError(stmt.errorMessage());
             return false;
         }
     }
-    sqlite3_close(db);
-    return true;
+    return tx.commit();
 }
 
-bool TermTfIrdf::load(int y, std::map<uint64_t, std::map<std::string, double>> *tfirdfs, bool loadDfs)
+bool TermTfIrdf::load(int y, std::map<uint64_t, std::map<uint32_t, double>> *tfirdfs, bool loadDfs)
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
-
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + path));
-        return false;
-    }
-    CallbackData data;
-    char *errorMessage = NULL;
-
     // step 1: load publication scope tfirdfs
     std::string keywords = _scope.getKeywords();
+    std::shared_ptr<TermDictionary> dict = _scope.dictionary();
     if (tfirdfs != NULL)
     {
         tfirdfs->clear();
         {
-            std::stringstream ss;
-            ss << "SELECT id, scope_keywords, year, tfirdfs FROM pub_scope_tfirdfs WHERE scope_keywords = '"
-                << keywords << "' AND year = " << y << ";";
-            logDebug(ss.str().c_str());
-            rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-            if (rc != SQLITE_OK)
-            {
-                logDebug(errorMessage);
-                sqlite3_close(db);
+            Statement stmt(_scope.preparePartition("SELECT id, tfirdfs FROM pub_scope_tfirdfs WHERE scope_keywords = ? AND year = ?;"));
+            if (!stmt.ok())
                 return false;
-            }
-            for (auto &result: data.results)
+            stmt.bind(1, keywords);
+            stmt.bind(2, y);
+            while (stmt.step())
             {
-                std::map<std::string, double> myTfirdfs;
-                uint64_t id = std::stoull(result["id"]);
-                std::string strTfirdfs = result["tfirdfs"];
-                std::vector<std::string> fields = splitString(strTfirdfs, ",");
-                for (std::string field: fields)
+                uint64_t id = stmt.getUInt64(0);
+                std::map<uint32_t, double> &myTfirdfs = (*tfirdfs)[id];
+                if (stmt.isBlob(1) && decodeTfirdfs(stmt.getBlob(1), myTfirdfs))
+                    continue;
+
+                // rows written by older versions are keyed by term
+                std::map<std::string, double> termTfirdfs;
+                if (stmt.isBlob(1))
+                {
+                    if (!decodeWeights(stmt.getBlob(1), termTfirdfs))
+                    {
+                        logError("Corrupted tfirdfs in pub_scope_tfirdfs.");
+                        return false;
+                    }
+                }
+                else
+                {
+                    meta::util::string_view text = stmt.getText(1);
+                    meta::util::string_view field, term, tfirdf;
+                    while (nextField(text, ',', field))
+                    {
+                        nextField(field, ':', term);
+                        nextField(field, ':', tfirdf);
+                        termTfirdfs[term.to_string()] = toDouble(tfirdf);
+                    }
+                }
+                myTfirdfs.clear();
+                for (auto termToTfirdf = termTfirdfs.begin(); termToTfirdf != termTfirdfs.end(); termToTfirdf++)
                 {
-                    std::vector<std::string> kv = splitString(field, ":");
-                    myTfirdfs[kv[0]] = atof(kv[1].c_str());
+                    myTfirdfs[dict->getId(termToTfirdf->first)] = termToTfirdf->second;
                 }
-                (*tfirdfs)[id] = myTfirdfs;
+            }
+            if (!stmt.done())
+            {
+                logDebug(stmt.errorMessage());
+                return false;
             }
         }
     }
 
 
     // step 2: load scope dfs
-    data.results.clear();
     if (loadDfs)
     {
-        std::stringstream ss;
-        ss << "SELECT keywords, year, num_works, dfs FROM scope_dfs WHERE keywords = '"
-            << keywords << "' AND year = " << y << ";";
-        logDebug(ss.str().c_str());
-        rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
+        Statement stmt(_scope.preparePartition("SELECT num_works, dfs FROM scope_dfs WHERE keywords = ? AND year = ?;"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        if (!stmt.step())
         {
-            logDebug(errorMessage);
-            sqlite3_close(db);
+            if (!stmt.done())
+                logDebug(stmt.errorMessage());
             return false;
         }
-        if (data.results.size() > 0)
-        {
-            _numWorks = atoi(data.results[0]["num_works"].c_str());
+        _numWorks = stmt.getInt(0);
 
-            std::string strDfs = data.results[0]["dfs"];
-            std::vector<std::string> fields = splitString(strDfs, ",");
-            for (std::string field: fields)
-            {
-                std::vector<std::string> kv = splitString(field, ":");
-                _dfs[kv[0]] = atoi(kv[1].c_str());
-            }
+        meta::util::string_view text = stmt.getText(1);
+        meta::util::string_view field, term, df;
+        while (nextField(text, ',', field))
+        {
+            nextField(field, ':', term);
+            nextField(field, ':', df);
+            _dfs[term.to_string()] = toInt(df);
         }
     }
     else
     {
-        std::stringstream ss;
-        ss << "SELECT keywords, year FROM scope_dfs WHERE keywords = '"
-            << keywords << "' AND year = " << y << ";";
-        logDebug(ss.str().c_str());
-        rc = sqlite3_exec(db, ss.str().c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
+        Statement stmt(_scope.preparePartition("SELECT year FROM scope_dfs WHERE keywords = ? AND year = ?;"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        if (!stmt.step())
         {
-            logDebug(errorMessage);
-            sqlite3_close(db);
+            if (!stmt.done())
+                logDebug(stmt.errorMessage());
             return false;
         }
     }
-    sqlite3_close(db);
-    return (data.results.size() > 0);
+    return true;
 }
 
 bool TermTfIrdf::process(int y)
@@ -291,8 +318,14 @@ bool TermTfIrdf::process(int y)
     }
 
     // step 3: compute tfirdfs
-    std::map<uint64_t, std::map<std::string, double>> tfirdfs;
+    std::shared_ptr<TermDictionary> dict = _scope.dictionary();
+    std::map<uint64_t, std::map<uint32_t, double>> tfirdfs;
     double logNumWorks = std::log(_numWorks);
+    std::map<std::string, std::pair<uint32_t, double>> irdfs;
+    for (auto termToDf = _dfs.begin(); termToDf != _dfs.end(); termToDf++)
+    {
+        irdfs[termToDf->first] = std::pair<uint32_t, double>(dict->getId(termToDf->first), logNumWorks - std::log(termToDf->second));
+    }
     std::queue<uint64_t> q;
     std::mutex mq;
     for (auto idToTF = termFreqs.begin(); idToTF != termFreqs.end(); idToTF++)
@@ -303,7 +336,7 @@ bool TermTfIrdf::process(int y)
     std::thread *threads[nThreads];
     for (int tid = 0; tid < nThreads; tid++)
     {
-        threads[tid] = new std::thread([&q, &mq, &termFreqs, &tfirdfs, logNumWorks, this]
+        threads[tid] = new std::thread([&q, &mq, &termFreqs, &tfirdfs, &irdfs, this]
             {
                 for (;;)
                 {
@@ -322,17 +355,16 @@ bool TermTfIrdf::process(int y)
                     if (idToTF == termFreqs.end())
                         return;
 
-                    std::map<std::string, double> myTfirdfs;
+                    std::map<uint32_t, double> myTfirdfs;
                     for (auto termToFreq = idToTF->second.begin(); termToFreq != idToTF->second.end(); termToFreq++)
                     {
-                        auto termToDf = _dfs.find(termToFreq->first);
-                        double irdf = logNumWorks - std::log(termToDf->second);
-                        double tfirdf = termToFreq->second.second * irdf;
-                        myTfirdfs[termToFreq->first] = tfirdf;
+                        const std::pair<uint32_t, double> &irdf = irdfs.find(termToFreq->first)->second;
+                        double tfirdf = termToFreq->second.second * irdf.second;
+                        myTfirdfs[irdf.first] = tfirdf;
                     }
                     {
                         std::lock_guard<std::mutex> lock(mq);
-                        tfirdfs[id] = myTfirdfs;
+                        tfirdfs[id].swap(myTfirdfs);
                     }
                     if (_cancelled.load() == true)
                     {
@@ -350,7 +382,14 @@ bool TermTfIrdf::process(int y)
     if (tfirdfs.size() < termFreqs.size())
         return false;
 
-    // step 4: save results
-    save(y, tfirdfs);
+    // step 4: save results while the next year is computed, together with the dfs so far
+    auto results = std::make_shared<std::map<uint64_t, std::map<uint32_t, double>>>();
+    results->swap(tfirdfs);
+    auto dfs = std::make_shared<std::map<std::string, int>>(_dfs);
+    int numWorks = _numWorks;
+    _scope.saveLater([this, y, results, dfs, numWorks]()
+        {
+            return save(y, *results, *dfs, numWorks);
+        });
     return true;
 }
@@ -2,7 +2,8 @@
 #include <../WESTSeerApp.h>
 #include <GeneralConfig.h>
 #include <StringProcessing.h>
-#include <CallbackData.h>
+#include <Transaction.h>
+#include <Blob.h>
 
 TimeSeriesExtraction::TimeSeriesExtraction(const std::string path, const std::string kws,
                                                BitermWeight *bw, CandidateIdentification *ci, TopicIdentification *ti):_scope(path, kws)
@@ -58,131 +59,122 @@ void TimeSeriesExtraction::doStep(int stepId)
         process(_y2 + 5);
 }
 
-Eigen::MatrixXd deserializeMatrix(std::string s)
+bool TimeSeriesExtraction::flush()
 {
-    std::vector<std::string> fields = splitString(s, ":");
-    std::vector<std::string> strRCs = splitString(fields[0], ",");
-    std::vector<std::string> strElements = splitString(fields[1], ",");
-    int nRows = atoi(strRCs[0].c_str());
-    int nCols = atoi(strRCs[1].c_str());
-    int nElements = (int) strElements.size();
+    return _scope.flush();
+}
+
+Eigen::MatrixXd deserializeMatrix(meta::util::string_view s)
+{
+    meta::util::string_view strRCs, strRows, strCols, strElement;
+    nextField(s, ':', strRCs);
+    nextField(strRCs, ',', strRows);
+    nextField(strRCs, ',', strCols);
+    int nRows = toInt(strRows);
+    int nCols = toInt(strCols);
     Eigen::MatrixXd A(nRows, nCols);
-    if (nRows * nCols != nElements)
-    {
-        logError("nRows * nCols != nElements");
-        return A;
-    }
-    int i = 0;
+    int nElements = 0;
     for (int r = 0; r < nRows; r++)
     {
         for (int c = 0; c < nCols; c++)
         {
-            A(r, c) = atof(strElements[i++].c_str());
+            if (!nextField(s, ',', strElement))
+                break;
+            A(r, c) = toDouble(strElement);
+            nElements++;
         }
     }
+    if (nRows * nCols != nElements || nextField(s, ',', strElement))
+    {
+        logError("nRows * nCols != nElements");
+    }
     return A;
 }
 
-bool TimeSeriesExtraction::load(int y, std::map<uint64_t, TimeSeriesMatrices> *timeSeries)
+// map a matrix blob written by serializeMatrix and copy it out in one go
+Eigen::MatrixXd decodeMatrix(meta::util::string_view bytes)
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
-
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
+    BlobReader blob(bytes);
+    uint64_t nRows = blob.readVarint();
+    uint64_t nCols = blob.readVarint();
+    meta::util::string_view data = blob.readBytes(nRows * nCols * sizeof(double));
+    if (!blob.ok() || !blob.atEnd())
     {
-        logError(wxT("Cannot open database at" + path));
-        return false;
+        logError("Corrupted matrix blob.");
+        return Eigen::MatrixXd();
     }
-    char *errorMessage = NULL;
+    return Eigen::Map<const Eigen::MatrixXd>((const double *)data.data(), nRows, nCols);
+}
+
+// read a matrix column, which older versions stored as text
+Eigen::MatrixXd getMatrix(const Statement &stmt, int col)
+{
+    if (stmt.isBlob(col))
+        return decodeMatrix(stmt.getBlob(col));
+    return deserializeMatrix(stmt.getText(col));
+}
 
+bool TimeSeriesExtraction::load(int y, std::map<uint64_t, TimeSeriesMatrices> *timeSeries)
+{
     // step 1: load time series
     std::string keywords = _scope.getKeywords();
     if (timeSeries != NULL)
     {
-        CallbackData data;
-        std::stringstream ss;
-        ss << "SELECT id, scope_keywords, year, plm, prm, slm, srm FROM pub_scope_time_series WHERE scope_keywords = '"
-            << keywords << "' AND year = " << y << ";";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logDebug(errorMessage);
-            sqlite3_close(db);
+        Statement stmt(_scope.preparePartition("SELECT id, plm, prm, slm, srm FROM pub_scope_time_series WHERE scope_keywords = ? AND year = ?;"));
+        if (!stmt.ok())
             return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        while (stmt.step())
+        {
+            uint64_t id = stmt.getUInt64(0);
+            TimeSeriesMatrices &tsm = (*timeSeries)[id];
+            tsm.first.first = getMatrix(stmt, 1);
+            tsm.first.second = getMatrix(stmt, 2);
+            tsm.second.first = getMatrix(stmt, 3);
+            tsm.second.second = getMatrix(stmt, 4);
         }
-        for (auto result: data.results)
+        if (!stmt.done())
         {
-            uint64_t id = std::stoull(result["id"]);
-            Eigen::MatrixXd plm = deserializeMatrix(result["plm"]);
-            Eigen::MatrixXd prm = deserializeMatrix(result["prm"]);
-            Eigen::MatrixXd slm = deserializeMatrix(result["slm"]);
-            Eigen::MatrixXd srm = deserializeMatrix(result["srm"]);
-            std::pair<Eigen::MatrixXd,Eigen::MatrixXd> pm(plm,prm);
-            std::pair<Eigen::MatrixXd,Eigen::MatrixXd> sm(slm,srm);
-            TimeSeriesMatrices tsm(pm,sm);
-            (*timeSeries)[id] = tsm;
+            logDebug(stmt.errorMessage());
+            return false;
         }
     }
 
     // step 2: load token
     {
-        CallbackData data;
-        std::stringstream ss;
-        ss << "SELECT keywords, year FROM scope_time_series_token WHERE keywords = '"
-            << keywords << "' AND year = " << y << ";";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logDebug(errorMessage);
-            sqlite3_close(db);
+        Statement stmt(_scope.preparePartition("SELECT year FROM scope_time_series_token WHERE keywords = ? AND year = ?;"));
+        if (!stmt.ok())
             return false;
-        }
-        if (data.results.size() == 0)
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        if (!stmt.step())
         {
-            sqlite3_close(db);
+            if (!stmt.done())
+                logDebug(stmt.errorMessage());
             return false;
         }
     }
-    sqlite3_close(db);
     return true;
 }
 
-std::string serializeMatrix(Eigen::MatrixXd &matrix)
+// write the shape followed by the column-major elements exactly as Eigen holds them in memory,
+// which is little-endian on every platform WESTSeer is built for
+std::string serializeMatrix(const Eigen::MatrixXd &matrix)
 {
-    std::stringstream ss;
-    int nRows = matrix.rows();
-    int nCols = matrix.cols();
-    ss << nRows << "," << nCols << ":";
-    for (int r = 0; r < nRows; r++)
-    {
-        for (int c = 0; c < nCols; c++)
-        {
-            if (r > 0 || c > 0)
-                ss << ",";
-            ss << matrix(r,c);
-        }
-    }
-    return ss.str();
+    BlobWriter blob;
+    blob.writeVarint(matrix.rows());
+    blob.writeVarint(matrix.cols());
+    blob.writeBytes(matrix.data(), matrix.size() * sizeof(double));
+    return blob.bytes();
 }
 
 bool TimeSeriesExtraction::save(int y, const std::map<uint64_t, TimeSeriesMatrices> &timeSeries)
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
-
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + path));
+    sqlite3 *db = _scope.partitionDb();
+    if (db == NULL)
         return false;
-    }
+    int rc = SQLITE_OK;
     char *errorMessage = NULL;
 
     // step 1: create tables
@@ -211,65 +203,61 @@ bool TimeSeriesExtraction::save(int y, const std::map<uint64_t, TimeSeriesMatric
         if (rc != SQLITE_OK)
         {
             logError(errorMessage);
-            sqlite3_close(db);
             return false;
         }
     }
 
     // step 2: insert publication scope time series
+    Transaction tx(db);
+    if (!tx.ok())
+        return false;
     std::string keywords = _scope.getKeywords();
     time_t t;
     time(&t);
-    if (timeSeries.size() > 0)
     {
-        std::stringstream ss;
-        ss << "INSERT OR IGNORE INTO pub_scope_time_series(id, scope_keywords, year, plm, prm, slm, srm) VALUES ";
+        Statement stmt(_scope.preparePartition("INSERT OR IGNORE INTO pub_scope_time_series(id, scope_keywords, year, plm, prm, slm, srm) VALUES (?,?,?,?,?,?,?);"));
+        if (!stmt.ok())
+            return false;
         for (auto idToTS = timeSeries.begin(); idToTS != timeSeries.end(); idToTS++)
         {
             uint64_t id = idToTS->first;
-            Eigen::MatrixXd plm = idToTS->second.first.first;
-            Eigen::MatrixXd prm = idToTS->second.first.second;
-            Eigen::MatrixXd slm = idToTS->second.second.first;
-            Eigen::MatrixXd srm = idToTS->second.second.second;
-            std::string strPlm = serializeMatrix(plm);
-            std::string strPrm = serializeMatrix(prm);
-            std::string strSlm = serializeMatrix(slm);
-            std::string strSrm = serializeMatrix(srm);
-            if (idToTS != timeSeries.begin())
-                ss << ",";
-            ss << "(" << id << ",'" << keywords << "'," << y << ",'"
-                << strPlm << "','" << strPrm << "','" << strSlm << "','" << strSrm << "')";
-        }
-        ss << ";";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), NULL, NULL, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logError(errorMessage);
-            sqlite3_close(db);
-            return false;
+            const Eigen::MatrixXd &plm = idToTS->second.first.first;
+            const Eigen::MatrixXd &prm = idToTS->second.first.second;
+            const Eigen::MatrixXd &slm = idToTS->second.second.first;
+            const Eigen::MatrixXd &srm = idToTS->second.second.second;
+            stmt.bind(1, id);
+            stmt.bind(2, keywords);
+            stmt.bind(3, y);
+            stmt.bindBlob(4, serializeMatrix(plm));
+            stmt.bindBlob(5, serializeMatrix(prm));
+            stmt.bindBlob(6, serializeMatrix(slm));
+            stmt.bindBlob(7, serializeMatrix(srm));
+            if (!stmt.execute())
+            {
+                logError(stmt.errorMessage());
+                return false;
+            }
+            if (!tx.step())
+                return false;
         }
     }
 
     // step 3: insert token
     {
-        std::stringstream ss;
-        ss << "INSERT OR IGNORE INTO scope_time_series_token(keywords,year,update_time) VALUES ('"
-            << keywords << "'," << y << "," << (int) t << ");";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), NULL, NULL, &errorMessage);
-        if (rc != SQLITE_OK)
+        Statement stmt(_scope.preparePartition("INSERT OR IGNORE INTO scope_time_series_token(keywords,year,update_time) VALUES (?,?,?);"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        stmt.bind(3, (int)t);
+        if (!stmt.execute())
         {
-            logError(errorMessage);
-            sqlite3_close(db);
+            logError(stmt.errorMessage());
             return false;
         }
     }
 
-    sqlite3_close(db);
-    return true;
+    return tx.commit();
 }
 
 bool TimeSeriesExtraction::process(int y)
@@ -291,7 +279,12 @@ bool TimeSeriesExtraction::process(int y)
     }
     if (candidateMap.size() == 0)
     {
-        save(y, timeSeries);
+        auto results = std::make_shared<std::map<uint64_t, TimeSeriesMatrices>>();
+        results->swap(timeSeries);
+        _scope.saveLater([this, y, results]()
+            {
+                return save(y, *results);
+            });
         return true;
     }
     GeneralConfig config;
@@ -320,24 +313,15 @@ bool TimeSeriesExtraction::process(int y)
         return false;
 
     // step 3: create mapping that maps biterm to candidate positions
-    std::map<std::string, std::vector<std::pair<uint64_t,int>>> bitermCandidatePositions;
-    for (auto cidToTopic: topics)
+    std::shared_ptr<TermDictionary> dict = _scope.dictionary();
+    std::map<Biterm, std::vector<std::pair<uint64_t,int>>> bitermCandidatePositions;
+    for (auto &cidToTopic: topics)
     {
         std::vector<std::string> biterms = splitString(cidToTopic.second.first, "|");
         for (int i = 0; i < (int)biterms.size(); i++)
         {
             std::pair<uint64_t,int> candidatePosition(cidToTopic.first,i);
-            auto bToCP = bitermCandidatePositions.find(biterms[i]);
-            if (bToCP == bitermCandidatePositions.end())
-            {
-                std::vector<std::pair<uint64_t,int>> temp;
-                temp.push_back(candidatePosition);
-                bitermCandidatePositions[biterms[i]] = temp;
-            }
-            else
-            {
-                bitermCandidatePositions[biterms[i]].push_back(candidatePosition);
-            }
+            bitermCandidatePositions[dict->getBiterm(biterms[i])].push_back(candidatePosition);
         }
     }
 
@@ -350,23 +334,29 @@ bool TimeSeriesExtraction::process(int y)
             continue;
         int iY = 14 - i;
 
-        std::map<uint64_t, std::vector<uint64_t>> pubs;
+        std::shared_ptr<const RefIdsOfId> pubs;
         if (!_scope.getExistingRefIds(yi, pubs))
             return false;
 
-        std::map<uint64_t, std::map<std::string, double>> pubBWs;
-        if (!_bw->load(yi, &pubBWs))
+        std::shared_ptr<const FeatureSnapshot> pubBWs;
+        if (!_bw->load(yi, pubBWs))
             return false;
 
-        for (auto &idToBWs: pubBWs)
+        for (size_t row = 0; row < pubBWs->numRows(); row++)
         {
-            std::set<uint64_t> refs(pubs[idToBWs.first].begin(), pubs[idToBWs.first].end());
+            uint64_t id = pubBWs->id(row);
+            std::set<uint64_t> refs;
+            auto idToRefIds = pubs->find(id);
+            if (idToRefIds != pubs->end())
+                refs.insert(idToRefIds->second.begin(), idToRefIds->second.end());
 
             // calculate pHits and tHits
             std::map<uint64_t, int> pHits, tHits;
-            for (auto &bToW: idToBWs.second)
+            size_t n = pubBWs->size(row);
+            const Biterm *biterms = pubBWs->keys(row);
+            for (size_t j = 0; j < n; j++)
             {
-                auto bToCP = bitermCandidatePositions.find(bToW.first);
+                auto bToCP = bitermCandidatePositions.find(biterms[j]);
                 if (bToCP != bitermCandidatePositions.end())
                 {
                     for (auto cp: bToCP->second)
@@ -475,7 +465,12 @@ bool TimeSeriesExtraction::process(int y)
         timeSeries[id] = tsm;
     }
 
-    // step 8: save time series
-    save(y, timeSeries);
+    // step 8: save time series while the next year is extracted
+    auto results = std::make_shared<std::map<uint64_t, TimeSeriesMatrices>>();
+    results->swap(timeSeries);
+    _scope.saveLater([this, y, results]()
+        {
+            return save(y, *results);
+        });
     return true;
 }
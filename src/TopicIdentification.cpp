@@ -2,7 +2,7 @@
 #include <../WESTSeerApp.h>
 #include <GeneralConfig.h>
 #include <StringProcessing.h>
-#include <CallbackData.h>
+#include <Transaction.h>
 #include <queue>
 #include <mutex>
 #include <thread>
@@ -62,81 +62,62 @@ void TopicIdentification::doStep(int stepId)
         process(_y2 + 5);
 }
 
-bool TopicIdentification::load(int y, std::map<uint64_t,std::pair<std::string,std::string>> *topics)
+bool TopicIdentification::flush()
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
-
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + path));
-        return false;
-    }
-    char *errorMessage = NULL;
+    return _scope.flush();
+}
 
+bool TopicIdentification::load(int y, std::map<uint64_t,std::pair<std::string,std::string>> *topics)
+{
     // step 1: load topics
     std::string keywords = _scope.getKeywords();
     if (topics != NULL)
     {
-        CallbackData data;
-        std::stringstream ss;
-        ss << "SELECT id, scope_keywords, year, topic FROM pub_scope_topics WHERE scope_keywords = '"
-            << keywords << "' AND year = " << y << ";";
-        std::string strSql = ss.str();
-        rc = sqlite3_exec(db, strSql.c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logDebug(errorMessage);
-            sqlite3_close(db);
+        Statement stmt(_scope.preparePartition("SELECT id, topic FROM pub_scope_topics WHERE scope_keywords = ? AND year = ?;"));
+        if (!stmt.ok())
             return false;
-        }
-        for (auto &result: data.results)
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        while (stmt.step())
         {
-            uint64_t id = std::stoull(result["id"]);
-            vector<std::string> strTopics = splitString(result["topic"],":");
-            std::pair<std::string,std::string> topic(strTopics[0], strTopics[1]);
+            uint64_t id = stmt.getUInt64(0);
+            meta::util::string_view text = stmt.getText(1);
+            meta::util::string_view biterms, summary;
+            nextField(text, ':', biterms);
+            nextField(text, ':', summary);
+            std::pair<std::string,std::string> topic(biterms.to_string(), summary.to_string());
             (*topics)[id] = topic;
         }
+        if (!stmt.done())
+        {
+            logDebug(stmt.errorMessage());
+            return false;
+        }
     }
 
     // step 2: load token
     {
-        CallbackData data;
-        std::stringstream ss;
-        ss << "SELECT keywords, year FROM scope_topic_token WHERE keywords = '"
-            << keywords << "' AND year = " << y << ";";
-        std::string strSql = ss.str();
-        rc = sqlite3_exec(db, strSql.c_str(), CallbackData::sqliteCallback, &data, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logDebug(errorMessage);
-            sqlite3_close(db);
+        Statement stmt(_scope.preparePartition("SELECT year FROM scope_topic_token WHERE keywords = ? AND year = ?;"));
+        if (!stmt.ok())
             return false;
-        }
-        if (data.results.size() == 0)
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        if (!stmt.step())
         {
-            sqlite3_close(db);
+            if (!stmt.done())
+                logDebug(stmt.errorMessage());
             return false;
         }
     }
-    sqlite3_close(db);
     return true;
 }
 
 bool TopicIdentification::save(int y, std::map<uint64_t,std::pair<std::string,std::string>> &topics)
 {
-    GeneralConfig config;
-    std::string path = config.getDatabase();
-
-    sqlite3 *db = NULL;
-    int rc = sqlite3_open(path.c_str(), &db);
-    if (rc != SQLITE_OK)
-    {
-        logError(wxT("Cannot open database at" + path));
+    sqlite3 *db = _scope.partitionDb();
+    if (db == NULL)
         return false;
-    }
+    int rc = SQLITE_OK;
     char *errorMessage = NULL;
 
     // step 1: create tables
@@ -162,34 +143,32 @@ bool TopicIdentification::save(int y, std::map<uint64_t,std::pair<std::string,st
         if (rc != SQLITE_OK)
         {
             logError(errorMessage);
-            sqlite3_close(db);
             return false;
         }
     }
 
     // step 2: save topics
+    Transaction tx(db);
+    if (!tx.ok())
+        return false;
     std::string keywords = _scope.getKeywords();
-    if (topics.size() > 0)
     {
-        std::stringstream ss;
-        ss << "INSERT OR IGNORE INTO pub_scope_topics(id, scope_keywords, year, topic) VALUES ";
+        Statement stmt(_scope.preparePartition("INSERT OR IGNORE INTO pub_scope_topics(id, scope_keywords, year, topic) VALUES (?,?,?,?);"));
+        if (!stmt.ok())
+            return false;
         for (auto idToTopic = topics.begin(); idToTopic != topics.end(); idToTopic++)
         {
-            if (idToTopic != topics.begin())
-                ss << ",";
-            ss << "(" << idToTopic->first << ",'" << keywords << "'," << y
-                << ",'" << idToTopic->second.first << ":" << idToTopic->second.second
-                << "')";
-        }
-        ss << ";";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), NULL, NULL, &errorMessage);
-        if (rc != SQLITE_OK)
-        {
-            logError(errorMessage);
-            sqlite3_close(db);
-            return false;
+            stmt.bind(1, idToTopic->first);
+            stmt.bind(2, keywords);
+            stmt.bind(3, y);
+            stmt.bind(4, idToTopic->second.first + ":" + idToTopic->second.second);
+            if (!stmt.execute())
+            {
+                logError(stmt.errorMessage());
+                return false;
+            }
+            if (!tx.step())
+                return false;
         }
     }
 
@@ -197,22 +176,20 @@ bool TopicIdentification::save(int y, std::map<uint64_t,std::pair<std::string,st
     time_t t;
     time(&t);
     {
-        std::stringstream ss;
-        ss << "INSERT OR IGNORE INTO scope_topic_token(keywords, year, update_time) VALUES ('"
-            << keywords << "'," << y << "," << (int)t << ");";
-        std::string strSql = ss.str();
-        logDebug(strSql.c_str());
-        rc = sqlite3_exec(db, strSql.c_str(), NULL, NULL, &errorMessage);
-        if (rc != SQLITE_OK)
+        Statement stmt(_scope.preparePartition("INSERT OR IGNORE INTO scope_topic_token(keywords, year, update_time) VALUES (?,?,?);"));
+        if (!stmt.ok())
+            return false;
+        stmt.bind(1, keywords);
+        stmt.bind(2, y);
+        stmt.bind(3, (int)t);
+        if (!stmt.execute())
         {
-            logError(errorMessage);
-            sqlite3_close(db);
+            logError(stmt.errorMessage());
             return false;
         }
     }
 
-    sqlite3_close(db);
-    return true;
+    return tx.commit();
 }
 
 bool TopicIdentification::process(int y)
@@ -232,38 +209,34 @@ bool TopicIdentification::process(int y)
     }
     if (candidateSet.size() == 0)
     {
-        return save(y, topics);
+        auto results = std::make_shared<std::map<uint64_t, std::pair<std::string, std::string>>>();
+        results->swap(topics);
+        _scope.saveLater([this, y, results]()
+            {
+                return save(y, *results);
+            });
+        return true;
     }
 
-    // step 2: load publications to get citers
+    // step 2: get citers of candidates
     logDebug("get Citers");
-    std::map<uint64_t, std::vector<uint64_t>> citers;
     for (int i = 0; i < 10; i++)
     {
-        int yi = y - 6 - i;
-        std::map<uint64_t, std::vector<uint64_t>> pubs;
-        if (!_scope.getExistingRefIds(yi, pubs))
+        if (!_scope.queried(y - 6 - i))
+            return false;
+    }
+    std::map<uint64_t, std::vector<uint64_t>> citers;
+    for (uint64_t cid: candidateSet)
+    {
+        std::map<int, std::set<uint64_t>> citersOfYear;
+        if (!_scope.getCiters(cid, y - 15, y - 5, citersOfYear))
             return false;
-        for (auto &idToRefIds: pubs)
+        if (citersOfYear.size() == 0)
+            continue;
+        std::vector<uint64_t> &myCiters = citers[cid];
+        for (auto &yToCiters: citersOfYear)
         {
-            uint64_t id = idToRefIds.first;
-            for (uint64_t refId: idToRefIds.second)
-            {
-                if (candidateSet.find(refId) != candidateSet.end())
-                {
-                    auto refIdToIds = citers.find(refId);
-                    if (refIdToIds != citers.end())
-                    {
-                        citers[refId].push_back(id);
-                    }
-                    else
-                    {
-                        std::vector<uint64_t> temp;
-                        temp.push_back(id);
-                        citers[refId] = temp;
-                    }
-                }
-            }
+            myCiters.insert(myCiters.end(), yToCiters.second.begin(), yToCiters.second.end());
         }
     }
 
@@ -281,14 +254,12 @@ bool TopicIdentification::process(int y)
 
     // step 4: load biterm weights
     logDebug("load biterm weights");
-    std::map<uint64_t, std::map<std::string, double>> pubBWs;
+    std::shared_ptr<const FeatureSnapshot> pubBWs[10];
     for (int i = 0; i < 10; i++)
     {
         int yi = y - 6 - i;
-        std::map<uint64_t, std::map<std::string, double>> pubBWsOfYi;
-        if (!_bw->load(yi, &pubBWsOfYi))
+        if (!_bw->load(yi, pubBWs[i]))
             return false;
-        pubBWs.insert(pubBWsOfYi.begin(), pubBWsOfYi.end());
     }
 
     // step 6: for each candidate, identify topic by the weights of the biterms
@@ -301,12 +272,13 @@ bool TopicIdentification::process(int y)
         q.push(c);
     }
     std::mutex mq;
+    std::shared_ptr<TermDictionary> dict = _scope.dictionary();
 
     int nThreads = std::thread::hardware_concurrency();
     std::thread *threads[nThreads];
     for (int tid = 0; tid < nThreads; tid++)
     {
-        threads[tid] = new std::thread([&q,&mq,&citers,&pubTerms,&pubBWs,numBitermsPerTopic,&topics]
+        threads[tid] = new std::thread([&q,&mq,&citers,&pubTerms,&pubBWs,numBitermsPerTopic,&topics,dict]
         {
             for (;;)
             {
@@ -323,24 +295,33 @@ bool TopicIdentification::process(int y)
                     return;
 
                 // create counters for the biterms
-                std::map<std::string, double> sumBWs;
+                std::map<Biterm, double> sumBWs;
                 auto refIdToIds = citers.find(cid);
                 if (refIdToIds == citers.end())
                     return;
                 for (uint64_t id : refIdToIds->second)
                 {
-                    auto idToBWs = pubBWs.find(id);
-                    if (idToBWs == pubBWs.end())
+                    const FeatureSnapshot *snapshot = NULL;
+                    size_t row = FeatureSnapshot::npos;
+                    for (int i = 0; i < 10 && snapshot == NULL; i++)
+                    {
+                        row = pubBWs[i]->find(id);
+                        if (row != FeatureSnapshot::npos)
+                            snapshot = pubBWs[i].get();
+                    }
+                    if (snapshot == NULL)
                         continue;
+                    size_t n = snapshot->size(row);
+                    const Biterm *biterms = snapshot->keys(row);
+                    const double *weights = snapshot->values(row);
 
                     // compute mean and var
                     double sum1 = 0.0, sum2 = 0.0;
-                    for (auto bToW: idToBWs->second)
+                    for (size_t j = 0; j < n; j++)
                     {
-                        sum1 += bToW.second;
-                        sum2 += bToW.second * bToW.second;
+                        sum1 += weights[j];
+                        sum2 += weights[j] * weights[j];
                     }
-                    size_t n = idToBWs->second.size();;
                     double mu = sum1 / n;
                     double sigma = sum2 / n - mu * mu;
                     if (sigma <= 0.0)
@@ -351,25 +332,25 @@ bool TopicIdentification::process(int y)
                     double sigmaSqrt2 = sigma * sqrt2;
 
                     // normalize weights and add them to sumBWs
-                    for (auto bToW: idToBWs->second)
+                    for (size_t j = 0; j < n; j++)
                     {
-                        double t = (bToW.second - mu) / sigmaSqrt2;
+                        double t = (weights[j] - mu) / sigmaSqrt2;
                         double w = 0.5 + 0.5 * erf(t);
-                        auto bToSumW = sumBWs.find(bToW.first);
+                        auto bToSumW = sumBWs.find(biterms[j]);
                         if (bToSumW != sumBWs.end())
                         {
-                            sumBWs[bToW.first] = bToSumW->second + w;
+                            bToSumW->second += w;
                         }
                         else
                         {
-                            sumBWs[bToW.first] = w;
+                            sumBWs[biterms[j]] = w;
                         }
                     }
                 }
 
                 // find top k biterms
                 std::vector<double> ws;
-                for (auto bToSumW: sumBWs)
+                for (auto &bToSumW: sumBWs)
                 {
                     ws.push_back(bToSumW.second);
                 }
@@ -379,22 +360,23 @@ bool TopicIdentification::process(int y)
                 {
                     threshold = ws[ws.size() - 1 - numBitermsPerTopic];
                 }
-                std::vector<std::string> topKBiterms;
-                for (auto bToSumW: sumBWs)
+                // keyed by "stem1&stem2", so that topics list their biterms alphabetically
+                std::map<std::string, Biterm> topKBiterms;
+                for (auto &bToSumW: sumBWs)
                 {
                     if (bToSumW.second > threshold)
                     {
-                        topKBiterms.push_back(bToSumW.first);
+                        topKBiterms[dict->getString(bToSumW.first)] = bToSumW.first;
                     }
                 }
                 // handles the situation where some top k weights equal threshold
                 if (topKBiterms.size() < numBitermsPerTopic && topKBiterms.size() < sumBWs.size())
                 {
-                    for (auto bToSumW: sumBWs)
+                    for (auto &bToSumW: sumBWs)
                     {
                         if (bToSumW.second == threshold && topKBiterms.size() < numBitermsPerTopic)
                         {
-                            topKBiterms.push_back(bToSumW.first);
+                            topKBiterms[dict->getString(bToSumW.first)] = bToSumW.first;
                             if (topKBiterms.size() == numBitermsPerTopic)
                                 break;
                         }
@@ -403,10 +385,9 @@ bool TopicIdentification::process(int y)
 
                 // find the most frequent representations of the top k biterms
                 std::vector<std::string> topKBiterms2;
-                topKBiterms2.resize(topKBiterms.size());
-                for (size_t i = 0; i < topKBiterms.size(); i++)
+                for (auto &strToBiterm: topKBiterms)
                 {
-                    std::vector<std::string> terms = splitString(topKBiterms[i], "&");
+                    std::vector<std::string> terms = splitString(strToBiterm.first, "&");
                     std::map<std::string, int> term1Dfs;
                     std::map<std::string, int> term2Dfs;
                     for (uint64_t id : refIdToIds->second)
@@ -466,20 +447,22 @@ bool TopicIdentification::process(int y)
                         }
                     }
 
-                    topKBiterms2[i] = term1 + "&" + term2;
+                    topKBiterms2.push_back(term1 + "&" + term2);
                 }
 
                 // create topic representation
                 std::string rep1, rep2;
-                for (size_t i = 0; i < topKBiterms.size(); i++)
+                size_t i = 0;
+                for (auto &strToBiterm: topKBiterms)
                 {
                     if (i > 0)
                     {
                         rep1 += "|";
                         rep2 += "|";
                     }
-                    rep1 += topKBiterms[i];
+                    rep1 += strToBiterm.first;
                     rep2 += topKBiterms2[i];
+                    i++;
                 }
 
                 // record topic
@@ -497,5 +480,12 @@ bool TopicIdentification::process(int y)
         threads[tid]->join();
         delete threads[tid];
     }
-    return save(y, topics);
+    // save topics while the next year is identified
+    auto results = std::make_shared<std::map<uint64_t, std::pair<std::string, std::string>>>();
+    results->swap(topics);
+    _scope.saveLater([this, y, results]()
+        {
+            return save(y, *results);
+        });
+    return true;
 }
@@ -0,0 +1,106 @@
+#include "Transaction.h"
+#include <wxFFileLog.h>
+
+std::mutex Transaction::_outermostMutex;
+std::map<sqlite3 *, Transaction *> Transaction::_outermost;
+
+Transaction::Transaction(sqlite3 *db, int batchSize)
+{
+    //ctor
+    _db = db;
+    _batchSize = batchSize;
+    _numRows = 0;
+    _owner = (db != NULL && sqlite3_get_autocommit(db) != 0);
+    _active = (db != NULL);
+    if (_owner)
+    {
+        _active = execute("BEGIN IMMEDIATE;");
+        if (_active)
+        {
+            std::lock_guard<std::mutex> lock(_outermostMutex);
+            _outermost[_db] = this;
+        }
+    }
+}
+
+Transaction::~Transaction()
+{
+    //dtor
+    if (_owner && _active)
+    {
+        execute("ROLLBACK;");
+    }
+    if (_owner)
+    {
+        std::lock_guard<std::mutex> lock(_outermostMutex);
+        auto dbToTx = _outermost.find(_db);
+        if (dbToTx != _outermost.end() && dbToTx->second == this)
+            _outermost.erase(dbToTx);
+    }
+}
+
+bool Transaction::execute(const char *sql)
+{
+    char *errorMessage = NULL;
+    logDebug(sql);
+    int rc = sqlite3_exec(_db, sql, NULL, NULL, &errorMessage);
+    if (rc != SQLITE_OK)
+    {
+        logError(errorMessage);
+        sqlite3_free(errorMessage);
+        return false;
+    }
+    return true;
+}
+
+// count a written row, committing the current batch once it is full
+bool Transaction::step()
+{
+    if (!_active)
+        return false;
+    if (!_owner || ++_numRows < _batchSize)
+        return true;
+    _numRows = 0;
+    _active = commitOwned() && execute("BEGIN IMMEDIATE;");
+    return _active;
+}
+
+bool Transaction::commit()
+{
+    if (!_active)
+        return false;
+    if (!_owner)
+        return true;
+    _active = false;
+    return commitOwned();
+}
+
+// run the action once the rows written so far are committed by the outermost transaction
+void Transaction::onCommit(std::function<void()> action)
+{
+    if (_owner)
+    {
+        _onCommit.push_back(std::move(action));
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_outermostMutex);
+    auto dbToTx = _outermost.find(_db);
+    if (dbToTx != _outermost.end())
+        dbToTx->second->_onCommit.push_back(std::move(action));
+}
+
+bool Transaction::commitOwned()
+{
+    if (!execute("COMMIT;"))
+    {
+        _onCommit.clear();
+        return false;
+    }
+    std::vector<std::function<void()>> actions;
+    actions.swap(_onCommit);
+    for (auto &action: actions)
+    {
+        action();
+    }
+    return true;
+}
@@ -0,0 +1,186 @@
+#include "WorksParser.h"
+#include <sstream>
+#include <StringProcessing.h>
+#include <wxFFileLog.h>
+
+// the fields of a work that a publication keeps, the only ones requested
+const char *WorksParser::FIELDS = "id,publication_year,title,abstract_inverted_index,primary_location,language,authorships,referenced_works";
+
+WorksParser::WorksParser(std::map<uint64_t, Publication> &pubs, std::vector<Publication> *samples) : _pubs(pubs)
+{
+    //ctor
+    _samples = samples;
+}
+
+WorksParser::~WorksParser()
+{
+    //dtor
+}
+
+// whether the parser is inside a work of the results, whose fields are then keyed at depth 2 of the path
+bool WorksParser::inWork() const
+{
+    return _path.size() >= 3 && _path[0] == "results";
+}
+
+const std::string &WorksParser::field() const
+{
+    return _path[2];
+}
+
+bool WorksParser::null()
+{
+    return true;
+}
+
+bool WorksParser::boolean(bool val)
+{
+    return true;
+}
+
+bool WorksParser::number_integer(number_integer_t val)
+{
+    if (inWork() && _path.size() == 3 && field() == "publication_year")
+        _pub._year = (int)val;
+    else if (val >= 0)
+        position((uint64_t)val);
+    return true;
+}
+
+bool WorksParser::number_unsigned(number_unsigned_t val)
+{
+    if (inWork() && _path.size() == 3 && field() == "publication_year")
+        _pub._year = (int)val;
+    else
+        position(val);
+    return true;
+}
+
+// a position of the current word of the abstract
+void WorksParser::position(uint64_t value)
+{
+    if (!inWork() || _path.size() != 5 || field() != "abstract_inverted_index" || _words.empty())
+        return;
+    if (value >= _wordOfPosition.size())
+        _wordOfPosition.resize(value + 1, -1);
+    _wordOfPosition[value] = _words.size() - 1;
+}
+
+bool WorksParser::number_float(number_float_t val, const string_t &s)
+{
+    return true;
+}
+
+bool WorksParser::string(string_t &val)
+{
+    if (!inWork())
+    {
+        if (_path.size() == 2 && _path[0] == "meta" && _path[1] == "next_cursor")
+            _nextCursor = val;
+        return true;
+    }
+    const std::string &name = field();
+    switch (_path.size())
+    {
+    case 3:
+        if (name == "id")
+            _pub._id = Publication::convertId(val, 'W');
+        else if (name == "publication_year")
+            _pub._year = atoi(val.c_str());
+        else if (name == "title")
+            _pub._title = wxStr(val);
+        else if (name == "language")
+            _pub._language = wxStr(val);
+        break;
+    case 4:
+        if (name == "referenced_works")
+            _pub._refIds.push_back(Publication::convertId(val, 'W'));
+        break;
+    case 5:
+        if (name == "primary_location" && _path[3] == "source" && _path[4] == "display_name")
+            _pub._source = wxStr(val);
+        break;
+    case 6:
+        if (name == "authorships" && _path[4] == "author" && _path[5] == "display_name")
+            _pub._authors.push_back(wxStr(Publication::convertAuthorName(val)));
+        break;
+    }
+    return true;
+}
+
+bool WorksParser::binary(binary_t &val)
+{
+    return true;
+}
+
+bool WorksParser::start_object(std::size_t elements)
+{
+    _path.push_back("");
+    if (inWork() && _path.size() == 3)
+    {
+        _pub = Publication();
+        _words.clear();
+        _wordOfPosition.clear();
+    }
+    return true;
+}
+
+bool WorksParser::key(string_t &val)
+{
+    if (_path.empty())
+        return false;
+    _path.back() = val;
+    if (inWork() && _path.size() == 4 && field() == "abstract_inverted_index")
+        _words.push_back(val);
+    return true;
+}
+
+bool WorksParser::end_object()
+{
+    if (_path.empty())
+        return false;
+    if (inWork() && _path.size() == 3)
+        finishWork();
+    _path.pop_back();
+    return true;
+}
+
+bool WorksParser::start_array(std::size_t elements)
+{
+    _path.push_back("");
+    return true;
+}
+
+bool WorksParser::end_array()
+{
+    if (_path.empty())
+        return false;
+    _path.pop_back();
+    return true;
+}
+
+bool WorksParser::parse_error(std::size_t position, const std::string &last_token, const nlohmann::detail::exception &ex)
+{
+    logError("%s", ex.what());
+    return false;
+}
+
+// rebuild the abstract of the work from its words and keep the work
+void WorksParser::finishWork()
+{
+    if (!_wordOfPosition.empty())
+    {
+        std::stringstream ss;
+        for (size_t i = 0; i < _wordOfPosition.size(); i++)
+        {
+            if (i > 0)
+                ss << " ";
+            if (_wordOfPosition[i] >= 0)
+                ss << _words[_wordOfPosition[i]];
+        }
+        _pub._abstract = wxStr(ss.str());
+    }
+    _pubs[_pub._id] = _pub;
+    if (_samples != NULL)
+        _samples->push_back(_pub);
+}
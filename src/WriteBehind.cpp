@@ -0,0 +1,116 @@
+#include "WriteBehind.h"
+#include <iterator>
+#include <Transaction.h>
+#include <wxFFileLog.h>
+
+static const size_t MAX_QUEUED_JOBS = 2;
+
+std::mutex WriteBehind::_registryMutex;
+std::map<std::string, std::weak_ptr<WriteBehind>> WriteBehind::_registry;
+
+WriteBehind::WriteBehind(std::shared_ptr<Database> db)
+{
+    //ctor
+    _db = db;
+    _numWriting = 0;
+    _failed = false;
+    _stopped = false;
+    _thread = std::thread(&WriteBehind::run, this);
+}
+
+WriteBehind::~WriteBehind()
+{
+    //dtor
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopped = true;
+    }
+    _queued.notify_all();
+    _thread.join();
+}
+
+// hand a job over to the writer, waiting while the queue is full
+void WriteBehind::push(std::function<bool()> job)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _written.wait(lock, [this]()
+        {
+            return _jobs.size() < MAX_QUEUED_JOBS;
+        });
+    _jobs.push_back(std::move(job));
+    lock.unlock();
+    _queued.notify_all();
+}
+
+// wait until every job handed over so far is written, returning false if any of them failed since the last flush
+bool WriteBehind::flush()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    _written.wait(lock, [this]()
+        {
+            return _jobs.empty() && _numWriting == 0;
+        });
+    bool result = !_failed;
+    _failed = false;
+    return result;
+}
+
+void WriteBehind::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;)
+    {
+        _queued.wait(lock, [this]()
+            {
+                return _stopped || !_jobs.empty();
+            });
+        if (_jobs.empty())
+            break;
+        std::vector<std::function<bool()>> jobs(std::make_move_iterator(_jobs.begin()), std::make_move_iterator(_jobs.end()));
+        _jobs.clear();
+        _numWriting = jobs.size();
+        lock.unlock();
+        _written.notify_all();
+
+        bool ok = write(jobs);
+        jobs.clear();
+
+        lock.lock();
+        _numWriting = 0;
+        if (!ok)
+            _failed = true;
+        _written.notify_all();
+    }
+}
+
+// run jobs in one transaction, rolling all of them back if any fails
+bool WriteBehind::write(std::vector<std::function<bool()>> &jobs)
+{
+    Transaction tx(_db->handle());
+    if (!tx.ok())
+        return false;
+    for (auto &job: jobs)
+    {
+        if (!job())
+        {
+            logError("%s", ("Failed to write to " + _db->path()).c_str());
+            return false;
+        }
+    }
+    return tx.commit();
+}
+
+std::shared_ptr<WriteBehind> WriteBehind::open(std::shared_ptr<Database> db)
+{
+    std::lock_guard<std::mutex> lock(_registryMutex);
+    auto pathToWriter = _registry.find(db->path());
+    if (pathToWriter != _registry.end())
+    {
+        std::shared_ptr<WriteBehind> writer = pathToWriter->second.lock();
+        if (writer)
+            return writer;
+    }
+    std::shared_ptr<WriteBehind> writer(new WriteBehind(db));
+    _registry[db->path()] = writer;
+    return writer;
+}